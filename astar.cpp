@@ -0,0 +1,173 @@
+#pragma once
+
+/// A* over the tree of move sequences. The maximum of the databases is
+/// consistent, so a node taken off the open list has its optimal g and, as the
+/// README notes, we need no closed list: a state reached twice is expanded
+/// twice, as in IDA*, but every node once instead of once per iteration.
+/// Nodes stay in an arena with a link to their parent, from which the
+/// solution is traced once the goal comes off the heap.
+
+// Entries of 8 bytes per 4 KiB page.
+#define BHEAP_PAGE 512
+#define BHEAP_LEAVES (BHEAP_PAGE / 2)
+// Heap keys are f << 6 | (31 - g) << 1 | lazy: lowest f first, then the
+// deepest node, then those whose h is exact.
+#define ASTAR_KEY(f, g, lazy) (u32(f) << 6 | u32(31 - (g)) << 1 | u32(lazy))
+
+struct HeapEntry {
+    u32 key;
+    u32 node;
+};
+
+// A binary heap in the layout of Kamp's B-heap. Every page holds a subtree of
+// 9 levels in slots 1..511, and the two children of each of its 256 leaves
+// are the roots of child pages. A sift touches a new page every 9 levels
+// instead of at every level below the first few, which matters for the TLB
+// once the heap holds millions of nodes. Positions are filled in array
+// order, skipping slot 0 of every page, so parents come before children.
+struct BHeap {
+    HeapEntry *a{nullptr};
+    // the next free position
+    u64 end{1};
+    u64 size{0};
+
+    static u64 Parent(u64 pos) {
+        u64 page = pos / BHEAP_PAGE, slot = pos % BHEAP_PAGE;
+        if (slot > 1) {
+            return page * BHEAP_PAGE + slot / 2;
+        }
+        page--;
+        return page / BHEAP_PAGE * BHEAP_PAGE + BHEAP_LEAVES +
+               page % BHEAP_PAGE / 2;
+    }
+
+    static u64 Child(u64 pos, u64 c) {
+        u64 page = pos / BHEAP_PAGE, slot = pos % BHEAP_PAGE;
+        if (slot < BHEAP_LEAVES) {
+            return pos + slot + c;
+        }
+        u64 child = page * BHEAP_PAGE + (slot - BHEAP_LEAVES) * 2 + c + 1;
+        return child * BHEAP_PAGE + 1;
+    }
+
+    // `a` must have room for position `end`.
+    void Push(HeapEntry e) {
+        u64 pos = end++;
+        end += end % BHEAP_PAGE == 0;
+        size++;
+        while (pos > 1) {
+            u64 parent = Parent(pos);
+            if (a[parent].key <= e.key) {
+                break;
+            }
+            a[pos] = a[parent];
+            pos = parent;
+        }
+        a[pos] = e;
+    }
+
+    HeapEntry Pop() {
+        HeapEntry top = a[1];
+        end--;
+        end -= end % BHEAP_PAGE == 0;
+        size--;
+        HeapEntry e = a[end];
+        u64 pos = 1;
+        while (true) {
+            u64 c = Child(pos, 0);
+            if (c >= end) {
+                break;
+            }
+            u64 c1 = Child(pos, 1);
+            if (c1 < end && a[c1].key < a[c].key) {
+                c = c1;
+            }
+            if (e.key <= a[c].key) {
+                break;
+            }
+            a[pos] = a[c];
+            pos = c;
+        }
+        a[pos] = e;
+        return top;
+    }
+};
+
+struct AStarNode {
+    Cube cube;
+    u32 parent;
+    u8 g;
+};
+
+// The nodes and the heap share a memory cap. Both are reserved at its full
+// size, like the fringe, and only backed as they grow.
+struct OpenList {
+    u64 limit{0};
+    u64 used{0};
+    AStarNode *nodes{nullptr};
+    u64 num_nodes{0};
+    BHeap heap;
+
+    ~OpenList() { Free(); }
+
+    bool Reset(u64 bytes) {
+        Free();
+        limit = bytes;
+        nodes = (AStarNode *)Reserve(limit);
+        heap.a = (HeapEntry *)Reserve(limit);
+        if (!nodes || !heap.a) {
+            Free();
+            return false;
+        }
+        return true;
+    }
+
+    void Free() {
+        if (nodes) {
+            munmap(nodes, limit);
+        }
+        if (heap.a) {
+            munmap(heap.a, limit);
+        }
+        nodes = nullptr;
+        heap = BHeap();
+        num_nodes = used = 0;
+    }
+
+    // Puts a node back on the heap with a new key.
+    bool Push(u32 node, u32 key) {
+        u64 bytes = (heap.end + 1) * sizeof(HeapEntry);
+        if (bytes > limit || num_nodes * sizeof(AStarNode) + bytes > limit) {
+            return false;
+        }
+        heap.Push({key, node});
+        used = num_nodes * sizeof(AStarNode) + heap.end * sizeof(HeapEntry);
+        return true;
+    }
+
+    bool Push(const Cube &cube, u32 parent, u8 g, u32 key) {
+        if (num_nodes == 0xffffffffu ||
+            (num_nodes + 1) * sizeof(AStarNode) > limit) {
+            return false;
+        }
+        nodes[num_nodes] = {cube, parent, g};
+        if (!Push(u32(num_nodes), key)) {
+            return false;
+        }
+        num_nodes++;
+        return true;
+    }
+
+    // The moves from the root, node 0, to `node`. Returns their number.
+    s32 Trace(u32 node, u8 *moves) const {
+        s32 n = 0;
+        for (u32 i = node; i != 0; i = nodes[i].parent) {
+            n++;
+        }
+        s32 k = n;
+        for (u32 i = node; i != 0; i = nodes[i].parent) {
+            moves[--k] = nodes[i].cube.GetLastMoveIndex() - 1;
+        }
+        return n;
+    }
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+/// Interleaved solving of many cubes on one core. Every lane runs the same
+/// IDA* as Search::Dfs(), but with an explicit stack, so it can stop after it
+/// prefetched the lookups of a node's children in all databases and let the
+/// other lanes run while the cache lines arrive. A single search only has the
+/// lookups of one node in flight at a time, the lanes together have many.
+///
+/// Prefetching all databases at once loads some entries that Dfs() would have
+/// skipped because the child already exceeds the bound, in exchange for a
+/// single yield per node.
+
+struct Frame {
+    Children children;
+    ChildIndices idx;
+    u32 todo;
+    s32 db;
+    s32 next;
+    u8 min;
+};
+
+struct Lane {
+    enum State { ENTER, LOOKUP, NEXT, DONE };
+
+    Search search;
+    Cube path[MAX_DEPTH];
+    Frame frames[MAX_DEPTH];
+    Cube root;
+    Solution *solution{nullptr};
+    State state{DONE};
+    s32 g{0};
+    u8 bound{0};
+
+    Lane(const DatabaseSet &dbs, const SolveOptions &options)
+        : search(dbs, options) {}
+
+    void Start(Cube cube, Solution *out) {
+        root = cube;
+        // as in IDAStar(), the scramble's last move does not restrict the first
+        cube.SetLastMoveIndex(0);
+        path[0] = cube;
+        solution = out;
+        *solution = Solution();
+        search.nodes = 0;
+        search.PollDatabases();
+        bound = search.Heuristic(cube, 0, NOT_FOUND);
+        g = 0;
+        state = ENTER;
+    }
+
+    // Prefetches the lookups of the children in all databases.
+    void Prefetch() {
+        Frame &f = frames[g];
+        for (s32 d = search.NextDatabase(-1, f.todo); d < 4;
+             d = search.NextDatabase(d, f.todo)) {
+            search.PrefetchChildren(d, f.idx, f.todo);
+        }
+        state = LOOKUP;
+    }
+
+    void Lookup() {
+        Frame &f = frames[g];
+        for (s32 d = search.NextDatabase(-1, f.todo); d < 4;
+             d = search.NextDatabase(d, f.todo)) {
+            f.todo = search.LookupChildren(d, f.idx, g, bound, f.children, f.todo);
+        }
+        search.nodes += f.children.n;
+        f.next = 0;
+        f.min = NOT_FOUND;
+        state = NEXT;
+    }
+
+    // Leaves the current node with `t`, like Dfs() returning it.
+    void Return(u8 t) {
+        if (g > 0) {
+            g--;
+            frames[g].min = Min(t, frames[g].min);
+            state = NEXT;
+            return;
+        }
+        if (t == NOT_FOUND) {
+            solution->nodes = search.nodes;
+            state = DONE;
+            return;
+        }
+        // next iteration
+        bound = t;
+        search.PollDatabases();
+        state = ENTER;
+    }
+
+    // Runs until the lane yields after a prefetch, false once it is done.
+    bool Step() {
+        while (true) {
+            switch (state) {
+                case ENTER: {
+                    if (path[g] == search.goal) {
+                        search.ExtractSolution(path, *solution);
+                        solution->optimal = true;
+                        solution->nodes = search.nodes;
+                        state = DONE;
+                        return false;
+                    }
+                    Frame &f = frames[g];
+                    search.ExpandChildren(path[g], f.children, f.idx);
+                    f.todo = (1u << f.children.n) - 1;
+                    Prefetch();
+                    return true;
+                }
+                case LOOKUP:
+                    Lookup();
+                    break;
+                case NEXT: {
+                    Frame &f = frames[g];
+                    if (f.next == f.children.n) {
+                        Return(f.min);
+                        break;
+                    }
+                    MoveBestToFront(f.children, f.next);
+                    u8 h = f.children.h[f.next];
+                    if (g + 1 + h > bound) {
+                        // like Dfs(), siblings searched before may have
+                        // found a smaller next bound
+                        Return(Min(u8(g + 1 + h), f.min));
+                        break;
+                    }
+                    path[g + 1] = f.children.cube[f.next];
+                    f.next++;
+                    g++;
+                    state = ENTER;
+                    break;
+                }
+                case DONE:
+                    return false;
+            }
+        }
+    }
+};
+
+void Solver::SolveBatch(const Cube *roots, Solution *solutions, s32 n,
+                        s32 width) const {
+    SolveOptions options;
+    Lane *lanes[MAX_LANES];
+    width = Min(Max(width, 1), MAX_LANES);
+
+    s32 next = 0;
+    auto start = [&](Lane *lane) {
+        while (next < n) {
+            s32 i = next++;
+            if (cache_ && cache_->Lookup(roots[i], solutions[i])) {
+                solutions[i].cached = true;
+                continue;
+            }
+            lane->Start(roots[i], &solutions[i]);
+            return;
+        }
+    };
+
+    for (s32 i = 0; i < width; i++) {
+        lanes[i] = new Lane(dbs_, options);
+        start(lanes[i]);
+    }
+
+    s32 active = width;
+    while (active > 0) {
+        active = 0;
+        for (s32 i = 0; i < width; i++) {
+            Lane *lane = lanes[i];
+            if (lane->state == Lane::DONE) {
+                continue;
+            }
+            if (!lane->Step()) {
+                if (cache_) {
+                    cache_->Insert(lane->root, *lane->solution);
+                }
+                start(lane);
+            }
+            active += lane->state != Lane::DONE;
+        }
+    }
+
+    for (s32 i = 0; i < width; i++) {
+        delete lanes[i];
+    }
+}
@@ -1,50 +1,172 @@
-internal Database cornerdb;
-internal Database edge1db;
-internal Database edge2db;
-internal Database permdb;
+// A level is generated bottom-up once the frontier is larger than the
+// unvisited entries divided by this ratio. Top-down costs a random update for
+// every child of the frontier, bottom-up a sequential scan plus a few random
+// reads for every unvisited entry, as most find a parent among their first
+// neighbors.
+#define BOTTOM_UP_RATIO 4
 
-using Indexer = u64 (*)(Cube &c);
+// Cubes expanded together by TopDown(). All of their children's entries are
+// prefetched before the first one is updated, so that many cache misses are in
+// flight at once instead of one per child.
+#define BFS_BATCH 64
 
-internal bool Bfs(Database &db, Indexer indexer) {
+// Expands the frontier in the queue, false if the queue ran out of space before
+// the level was complete.
+internal bool TopDown(Database &db, Indexer indexer, Deque<Cube> &q, s64 depth,
+                      u64 &found) {
+    Cube children[BFS_BATCH * 18];
+    u64 index[BFS_BATCH * 18];
+    u64 size = q.Size();
+    for (u64 i = 0; i < size;) {
+        u64 n = Min(u64(BFS_BATCH), size - i);
+        n = Min(n, (q.Capacity() - Min(q.Size(), q.Capacity())) / 18);
+        if (n == 0) {
+            return false;
+        }
+        s32 m = 0;
+        for (u64 k = 0; k < n; k++) {
+            Cube cube = q.Pop();
+            u32 valid = kValidMoves[cube.GetLastMoveIndex()];
+            while (valid) {
+                s32 move = __builtin_ffs(valid) - 1;
+                valid &= valid - 1;
+                children[m] = cube;
+                ApplyMove(children[m], move);
+                index[m] = indexer(children[m]);
+                db.PrefetchWrite(index[m]);
+                m++;
+            }
+        }
+        // duplicates within the batch are caught here, as only the first
+        // update of an entry lowers it
+        for (s32 k = 0; k < m; k++) {
+            if (db.Update(index[k], depth)) {
+                q.Push(children[k]);
+                found++;
+            }
+        }
+        i += n;
+    }
+    return true;
+}
+
+// Visits every unvisited entry and sets it to `depth` if any of its neighbors
+// is at depth - 1. The neighbors are prefetched together, and we stop at the
+// first parent. Returns the number of unvisited entries that were scanned.
+internal u64 BottomUp(Database &db, Indexer indexer, Unranker unrank, s64 depth,
+                      u64 &found) {
+    const u64 *words = (const u64 *)db.data;
+    u64 n = db.hdr->num_entries;
+    u64 scanned = 0;
+    Cube cube;
+    Init(cube);
+    for (u64 w = 0; w * 16 < n; w++) {
+        // a nibble is 0xf if all of its bits are set
+        u64 x = w * 16 + 16 <= n ? words[w] : 0xffffffffffffffffull;
+        if (((x & (x >> 1) & (x >> 2) & (x >> 3)) & 0x1111111111111111ull) == 0) {
+            continue;
+        }
+        for (u64 i = w * 16; i < Min(w * 16 + 16, n); i++) {
+            if (db.Get(i) != 0xf) {
+                continue;
+            }
+            scanned++;
+            unrank(i, cube);
+            u64 index[18];
+            for (s32 move = 0; move < 18; move++) {
+                Cube next = cube;
+                ApplyMove(next, move);
+                index[move] = indexer(next);
+                db.Prefetch(index[move]);
+            }
+            for (s32 move = 0; move < 18; move++) {
+                if (db.Get(index[move]) == depth - 1) {
+                    db.Update(i, depth);
+                    found++;
+                    break;
+                }
+            }
+        }
+    }
+    return scanned;
+}
+
+// Fills the queue with all entries at `depth`, to go top-down again after
+// bottom-up levels. False if they do not fit.
+internal bool Refill(Database &db, Unranker unrank, Deque<Cube> &q, s64 depth) {
+    q.Clear();
+    Cube cube;
+    Init(cube);
+    for (u64 i = 0; i < db.hdr->num_entries; i++) {
+        if (db.Get(i) == depth) {
+            if (q.Size() == q.Capacity()) {
+                return false;
+            }
+            unrank(i, cube);
+            q.Push(cube);
+        }
+    }
+    return true;
+}
+
+internal bool Bfs(Database &db, Indexer indexer, Unranker unrank) {
     timespec start, end;
     Deque<Cube> q(db.hdr->num_entries * 0.6);
     Cube root;
     Init(root);
     q.Push(root);
     s64 depth = 0;
-    s64 nodes = 0;
+    u64 visited = 1;
+    u64 frontier = 1;
+    // whether the queue holds the frontier
+    bool queued = true;
+    PerfCounters perf;
+    u64 misses[PerfCounters::NUM_COUNTERS];
 
     db.Update(indexer(root), depth);
-    while (q.Size()) {
+    while (frontier && visited < db.hdr->num_entries) {
         clock_gettime(CLOCK_MONOTONIC, &start);
+        perf.Lap(misses);
         depth++;
-        u64 size = q.Size();
+        u64 todo = db.hdr->num_entries - visited;
+        bool bottom_up = frontier * BOTTOM_UP_RATIO > todo;
+        if (!bottom_up && !queued) {
+            queued = Refill(db, unrank, q, depth - 1);
+            bottom_up = !queued;
+        }
 
-        for (u64 i = 0; i < size; i++) {
-            Cube &cube = q.Pop();
-            u32 valid = kValidMoves[cube.GetLastMoveIndex()];
-            while (valid) {
-                if (q.Size() == db.hdr->num_entries) {
-                    return false;
-                }
-                s32 move = __builtin_ffs(valid) - 1;
-                valid &= valid - 1;
-                Cube next = cube;
-                ApplyMove(next, move);
-                if (db.Update(indexer(next), depth)) {
-                    q.Push(next);
-                }
-            }
+        u64 found = 0, processed = frontier;
+        const char *mode = "top-down";
+        if (!bottom_up && !TopDown(db, indexer, q, depth, found)) {
+            // the rest of the level is found bottom-up, which only needs the
+            // entries that are already set
+            mode = "top-down+bottom-up";
+            bottom_up = true;
+        } else if (bottom_up) {
+            mode = "bottom-up";
+        }
+        if (bottom_up) {
+            processed = BottomUp(db, indexer, unrank, depth, found);
+            q.Clear();
+            queued = false;
         }
 
-        nodes += size;
+        visited += found;
+        frontier = found;
+        perf.Lap(misses);
         clock_gettime(CLOCK_MONOTONIC, &end);
 
         double elapsed = Timespec2Sec(&end) - Timespec2Sec(&start);
         printf(
-            "Depth:%02lu MiB:%04lu Time:%0.3f Todo:%'lu Nodes:%'lu Nps:%'0lu\n",
-            depth, q.Size() * sizeof(Cube) / u32(MiB(1)), elapsed, db.hdr->num_entries - nodes, nodes,
-            u64(size / elapsed));
+            "Depth:%02lu MiB:%04lu Time:%0.3f Todo:%'lu Nodes:%'lu Nps:%'0lu "
+            "Mode:%s Frontier:%'lu\n",
+            depth, q.Size() * sizeof(Cube) / u32(MiB(1)), elapsed,
+            db.hdr->num_entries - visited, visited, u64(processed / elapsed), mode,
+            found);
+        if (perf.Available()) {
+            printf("LLC:%'lu dTLB:%'lu\n", misses[PerfCounters::LLC_MISSES],
+                   misses[PerfCounters::DTLB_MISSES]);
+        }
     }
     return true;
 }
@@ -0,0 +1,124 @@
+#pragma once
+
+/// Bidirectional breadth-first search for short scrambles: one side grows
+/// from the scramble, the other from the goal, a level at a time, always the
+/// side with the smaller last level. The first state found by both sides is
+/// on a shortest path, since every path of length dF + dB would have met at
+/// an earlier level. No databases are used.
+///
+/// Each side keeps its states in an open-addressing table. An entry is a
+/// packed Cube, whose corners hold more than the state above bit 48, where
+/// Cube's operator== does not look:
+///
+///   [48..52] the move that first reached the state, as in Cube
+///   [53..58] the faces of every move that reached it at its depth
+///   [59..63] its depth
+///
+/// The faces decide which moves it is expanded with. A state reached at the
+/// same depth through moves on both faces of an axis must allow the moves of
+/// either, or some canonical sequences would be lost. The parent of a state is
+/// found again by undoing its move, which traces the path back.
+
+#define BIDIR_FACE_SHIFT 53
+#define BIDIR_DEPTH_SHIFT 59
+// Scrambles solved in more moves go back to IDA*.
+#define BIDIR_MAX_DEPTH 12
+#define BIDIR_MIN_SLOTS KiB(4)
+
+internal u64 StateHash(const Cube &c) {
+    u64 corners = c.corners & 0xffffffffffffull;
+    u64 h = c.edges * 0x9e3779b97f4a7c15ull ^ corners * 0xc2b2ae3d27d4eb4full;
+    return h ^ (h >> 29);
+}
+
+internal u32 InverseMove(u32 move) { return move / 3 * 3 + 2 - move % 3; }
+
+// No cube has all corners in slot 0, zero corners mark an empty slot.
+struct StateTable {
+    Cube *slots{nullptr};
+    u64 mask{0};
+    u64 size{0};
+    // states of the deepest level
+    u64 last{0};
+    u8 depth{0};
+
+    ~StateTable() { free(slots); }
+
+    u64 Bytes() const { return (mask + 1) * sizeof(Cube); }
+
+    static u8 Depth(const Cube &c) { return c.corners >> BIDIR_DEPTH_SHIFT; }
+
+    static u32 Faces(const Cube &c) {
+        return (c.corners >> BIDIR_FACE_SHIFT) & 0b111111;
+    }
+
+    // The moves to expand a state with.
+    static u32 Allowed(const Cube &c) {
+        u32 faces = Faces(c), allowed = faces ? 0 : kValidMoves[0];
+        for (; faces; faces &= faces - 1) {
+            allowed |= kValidMoves[__builtin_ctz(faces) * 3 + 1];
+        }
+        return allowed;
+    }
+
+    bool Allocate(u64 n) {
+        Cube *old = slots;
+        u64 old_slots = old ? mask + 1 : 0;
+        slots = (Cube *)calloc(n, sizeof(Cube));
+        if (slots == NULL) {
+            slots = old;
+            return false;
+        }
+        mask = n - 1;
+        for (u64 i = 0; i < old_slots; i++) {
+            if (old[i].corners) {
+                *Probe(old[i]) = old[i];
+            }
+        }
+        free(old);
+        return true;
+    }
+
+    // The slot of `c`, or the empty slot where it belongs.
+    Cube *Probe(const Cube &c) const {
+        for (u64 i = StateHash(c) & mask;; i = (i + 1) & mask) {
+            if (slots[i].corners == 0 || slots[i] == c) {
+                return &slots[i];
+            }
+        }
+    }
+
+    const Cube *Find(const Cube &c) const {
+        const Cube *s = Probe(c);
+        return s->corners ? s : nullptr;
+    }
+
+    // Adds `c`, reached with its last move at `depth`. Returns whether it is
+    // new to the table.
+    bool Insert(const Cube &c, u8 depth) {
+        Cube *s = Probe(c);
+        u32 move = c.GetLastMoveIndex();
+        u64 face = move ? 1ull << ((move - 1) / 3 + BIDIR_FACE_SHIFT) : 0;
+        if (s->corners) {
+            if (Depth(*s) == depth) {
+                s->corners |= face;
+            }
+            return false;
+        }
+        *s = c;
+        s->corners |= face | u64(depth) << BIDIR_DEPTH_SHIFT;
+        size++;
+        return true;
+    }
+
+    // The moves from the origin to `c`, returns their number.
+    s32 Trace(Cube c, u8 *moves) const {
+        s32 n = Depth(*Find(c));
+        for (s32 k = n; k > 0; k--) {
+            u32 move = Find(c)->GetLastMoveIndex() - 1;
+            moves[k - 1] = move;
+            ApplyMove(c, InverseMove(move));
+        }
+        return n;
+    }
+};
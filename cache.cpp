@@ -0,0 +1,170 @@
+#pragma once
+
+#include "symmetry.cpp"
+
+#define CACHE_MAGIC 0xfeffc2fb
+#define CACHE_WAYS 4
+
+// Entries are grouped in buckets of CACHE_WAYS, a full bucket evicts its least
+// recently used entry. A zero stamp marks an empty entry.
+struct SolutionCache::Entry {
+    u64 corners;
+    u64 edges;
+    u32 stamp;
+    u8 length;
+    u8 moves[MAX_DEPTH];
+};
+
+internal u64 CacheHash(const Cube &c) {
+    u64 h = c.edges * 0x9e3779b97f4a7c15ull ^ c.corners * 0xc2b2ae3d27d4eb4full;
+    return h ^ (h >> 29);
+}
+
+SolutionCache::SolutionCache(u64 capacity) {
+    u64 n = CACHE_WAYS;
+    while (n < capacity) {
+        n <<= 1;
+    }
+    entries_ = (Entry *)calloc(n, sizeof(Entry));
+    mask_ = entries_ ? n - 1 : 0;
+    pthread_mutex_init(&lock_, NULL);
+    GetSymmetries();
+}
+
+SolutionCache::~SolutionCache() {
+    free(entries_);
+    pthread_mutex_destroy(&lock_);
+}
+
+SolutionCache::Entry *SolutionCache::Find(const Cube &key) {
+    if (entries_ == NULL) {
+        return NULL;
+    }
+    Entry *bucket = entries_ + (CacheHash(key) & mask_ & ~u64(CACHE_WAYS - 1));
+    for (s32 i = 0; i < CACHE_WAYS; i++) {
+        if (bucket[i].stamp && bucket[i].corners == key.corners &&
+            bucket[i].edges == key.edges) {
+            return &bucket[i];
+        }
+    }
+    return NULL;
+}
+
+bool SolutionCache::Lookup(const Cube &cube, Solution &solution) {
+    f64 start = Now();
+    Cube key;
+    s32 s = Canonicalize(cube, key);
+    const Symmetries &sym = GetSymmetries();
+
+    pthread_mutex_lock(&lock_);
+    Entry *e = Find(key);
+    if (e) {
+        e->stamp = ++clock_;
+        solution.length = e->length;
+        solution.optimal = true;
+        solution.nodes = 0;
+        // the stored moves solve the canonical cube, map them back
+        for (s32 i = 0; i < e->length; i++) {
+            solution.moves[i] = sym.move[sym.inverse[s]][e->moves[i]];
+        }
+        stats_.hits++;
+    } else {
+        stats_.misses++;
+    }
+    stats_.lookup_time += Now() - start;
+    pthread_mutex_unlock(&lock_);
+    return e != NULL;
+}
+
+void SolutionCache::Insert(const Cube &cube, const Solution &solution) {
+    if (solution.length < 0 || !solution.optimal) {
+        return;
+    }
+    Cube key;
+    s32 s = Canonicalize(cube, key);
+    const Symmetries &sym = GetSymmetries();
+
+    pthread_mutex_lock(&lock_);
+    Entry *e = Find(key);
+    if (e == NULL && entries_ != NULL) {
+        Entry *bucket = entries_ + (CacheHash(key) & mask_ & ~u64(CACHE_WAYS - 1));
+        e = &bucket[0];
+        for (s32 i = 1; i < CACHE_WAYS; i++) {
+            if (bucket[i].stamp < e->stamp) {
+                e = &bucket[i];
+            }
+        }
+        stats_.evictions += e->stamp != 0;
+        stats_.inserts++;
+    }
+    if (e) {
+        e->corners = key.corners;
+        e->edges = key.edges;
+        e->stamp = ++clock_;
+        e->length = solution.length;
+        for (s32 i = 0; i < solution.length; i++) {
+            e->moves[i] = sym.move[s][solution.moves[i]];
+        }
+    }
+    pthread_mutex_unlock(&lock_);
+}
+
+// The file is a magic and entry count followed by the used entries. Loading
+// inserts them again, so the capacity may differ between runs.
+bool SolutionCache::Load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    u32 magic = 0;
+    u64 n = 0;
+    bool ok = fread(&magic, sizeof(magic), 1, file) == 1 &&
+              fread(&n, sizeof(n), 1, file) == 1 && magic == CACHE_MAGIC;
+    for (u64 i = 0; ok && i < n; i++) {
+        Entry e;
+        ok = fread(&e, sizeof(e), 1, file) == 1;
+        if (ok) {
+            Cube key;
+            key.corners = e.corners;
+            key.edges = e.edges;
+            Solution solution;
+            solution.length = e.length;
+            solution.optimal = true;
+            memcpy(solution.moves, e.moves, sizeof(e.moves));
+            Insert(key, solution);
+        }
+    }
+    fclose(file);
+    stats_.inserts = stats_.evictions = 0;
+    return ok;
+}
+
+bool SolutionCache::Save(const char *path) const {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("fopen");
+        return false;
+    }
+    pthread_mutex_lock(&lock_);
+    u32 magic = CACHE_MAGIC;
+    u64 n = 0;
+    for (u64 i = 0; entries_ && i <= mask_; i++) {
+        n += entries_[i].stamp != 0;
+    }
+    fwrite(&magic, sizeof(magic), 1, file);
+    fwrite(&n, sizeof(n), 1, file);
+    for (u64 i = 0; entries_ && i <= mask_; i++) {
+        if (entries_[i].stamp) {
+            fwrite(&entries_[i], sizeof(Entry), 1, file);
+        }
+    }
+    pthread_mutex_unlock(&lock_);
+    return fclose(file) == 0;
+}
+
+CacheStats SolutionCache::Stats() const {
+    pthread_mutex_lock(&lock_);
+    CacheStats stats = stats_;
+    pthread_mutex_unlock(&lock_);
+    return stats;
+}
@@ -1,10 +1,81 @@
+#pragma once
+
 #define MAGIC 0xfeffc2f9
+// Same header, but one entry per byte instead of per nibble. Only written and
+// read by `dbtool convert` for use with external tools.
+#define MAGIC_BYTES 0xfeffc2fa
+
+// Counts the nibbles per value in data[0..size). With AVX2 we compare 32
+// bytes at a time against each value and accumulate the matches in byte
+// counters, which are flushed with a sum of absolute differences every 127
+// vectors, before they can overflow. 8 counters fit in registers at a time, so
+// every block is counted in two passes, values 0-7 and 8-15, while it is still
+// in L1. The bytes after the last whole vector are counted one at a time.
+internal void CountNibbles(const u8 *data, u64 size, u64 counts[16]) {
+    u64 i = 0;
+#ifdef __AVX2__
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    u64 vectors = size / 32;
+    u64 done = 0;
+    while (done < vectors) {
+        u64 n = Min(vectors - done, u64(127));
+        const u8 *block = data + done * 32;
+        for (s32 pass = 0; pass < 2; pass++) {
+            __m256i acc[8];
+            for (s32 k = 0; k < 8; k++) {
+                acc[k] = zero;
+            }
+            for (u64 j = 0; j < n; j++) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(block + j * 32));
+                __m256i lo = _mm256_and_si256(v, mask);
+                __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+                for (s32 k = 0; k < 8; k++) {
+                    __m256i value = _mm256_set1_epi8(pass * 8 + k);
+                    acc[k] = _mm256_sub_epi8(acc[k], _mm256_cmpeq_epi8(lo, value));
+                    acc[k] = _mm256_sub_epi8(acc[k], _mm256_cmpeq_epi8(hi, value));
+                }
+            }
+            for (s32 k = 0; k < 8; k++) {
+                __m256i sum = _mm256_sad_epu8(acc[k], zero);
+                counts[pass * 8 + k] += _mm256_extract_epi64(sum, 0) +
+                                        _mm256_extract_epi64(sum, 1) +
+                                        _mm256_extract_epi64(sum, 2) +
+                                        _mm256_extract_epi64(sum, 3);
+            }
+        }
+        done += n;
+    }
+    i = vectors * 32;
+#endif
+    for (; i < size; i++) {
+        counts[data[i] & 0xf]++;
+        counts[data[i] >> 4]++;
+    }
+}
+
+struct HistogramJob {
+    const u8 *data;
+    u64 size;
+    u64 counts[16];
+};
+
+internal void *HistogramWorker(void *arg) {
+    HistogramJob *job = (HistogramJob *)arg;
+    CountNibbles(job->data, job->size, job->counts);
+    return NULL;
+}
 
 struct Database {
-    enum Type { INVALID, CORNER, EDGE1, EDGE2, PERMUTATION };
+    enum Type : u16 { INVALID, CORNER, EDGE1, EDGE2, PERMUTATION };
+    // How states are numbered, see IndexerFor(). LOCAL is only defined for
+    // the corners. Older files stored the type in 32 bits, so their ordering
+    // reads as STANDARD.
+    enum Ordering : u16 { STANDARD, LOCAL };
     struct Header {
         u32 magic{MAGIC};
         Type type{INVALID};
+        Ordering ordering{STANDARD};
         u64 num_entries{0};
         u64 size{0};
     };
@@ -12,6 +83,9 @@ struct Database {
     Header *hdr{nullptr};
     u8 *data{nullptr};
     void *map{nullptr};
+    // Cleared while DatabaseSet::LoadAsync() is still reading the database in
+    // from disk, lookups must skip it until then.
+    bool ready{true};
 
     void Write(const char *path) {
         FILE *file;
@@ -21,7 +95,7 @@ struct Database {
         free(map);
     }
 
-    bool Alloc(u64 n, Type type) {
+    bool Alloc(u64 n, Type type, Ordering ordering = STANDARD) {
         u64 size = n >> 1;
         map = malloc(size + sizeof(Header));
         if (map == NULL) {
@@ -34,6 +108,7 @@ struct Database {
         hdr->magic = MAGIC;
         hdr->size = size;
         hdr->type = type;
+        hdr->ordering = ordering;
         memset(data, 0xff, size);
         return true;
     }
@@ -71,6 +146,7 @@ struct Database {
 
         hdr->magic = MAGIC;
         hdr->type = type;
+        hdr->ordering = STANDARD;
         hdr->num_entries = n;
         hdr->size = n >> 1;
         memset(data, 0xff, hdr->size);
@@ -78,7 +154,8 @@ struct Database {
         return true;
     }
 
-    bool MemoryMapReadOnly(const char *path, Type type) {
+    // Maps an existing database, INVALID accepts a database of any type.
+    bool MemoryMapReadOnly(const char *path, Type type = INVALID) {
         int fd = open(path, O_RDONLY);
         if (fd == -1) {
             perror("open");
@@ -101,9 +178,13 @@ struct Database {
         hdr = (Header*) map;
         data = (u8*) map + sizeof(Header);
 
-        return hdr->magic == MAGIC && hdr->type == type;
+        return hdr->magic == MAGIC && (type == INVALID || hdr->type == type);
     }
 
+    // Decodes a packed database, see pack.cpp, into memory with `threads`
+    // threads. INVALID accepts a database of any type.
+    bool LoadPacked(const char *path, Type type, s32 threads);
+
     bool Update(u64 i, u8 depth) {
         assert(i < hdr->num_entries);
         u8 shift = i & 1;
@@ -118,7 +199,12 @@ struct Database {
         return v > depth;
     }
 
-    u8 Get(u64 i) {
+    void Prefetch(u64 i) const { __builtin_prefetch(data + (i >> 1)); }
+
+    // Prefetches the line of entry i for an Update().
+    void PrefetchWrite(u64 i) const { __builtin_prefetch(data + (i >> 1), 1); }
+
+    u8 Get(u64 i) const {
         assert(i < hdr->num_entries);
         u8 shift = i & 1;
         shift *= 4;
@@ -126,18 +212,78 @@ struct Database {
         return (data[i] >> shift) & 0xf;
     }
 
-    f64 Mean() {
-        u64 sum = 0;
-        u64 n = hdr->size / sizeof(u64);
-        assert(hdr->num_entries % n == 0);
-        u64 *ptr = (u64*) data;
-        for (u64 i = 0; i < n; i++) {
-            u64 v = ptr[i];
-            while (v) {
-                sum += v & 0xf;
-                v >>= 4;
+    bool Ready() const { return __atomic_load_n(&ready, __ATOMIC_ACQUIRE); }
+
+    // Whether every page of the mapping is in the page cache.
+    bool Resident() const {
+        u64 page = sysconf(_SC_PAGESIZE);
+        u64 pages = (sizeof(Header) + hdr->size + page - 1) / page;
+        u8 *vec = (u8 *)malloc(pages);
+        if (vec == NULL || mincore(map, pages * page, vec) == -1) {
+            free(vec);
+            return false;
+        }
+        u64 resident = 0;
+        for (u64 i = 0; i < pages; i++) {
+            resident += vec[i] & 1;
+        }
+        free(vec);
+        return resident == pages;
+    }
+
+    // Faults in every page of the mapping, after which the database is ready.
+    // The kernel reads ahead sequentially, rather than one random page per
+    // lookup as the search would.
+    void ReadAhead() {
+        u64 page = sysconf(_SC_PAGESIZE);
+        u64 size = sizeof(Header) + hdr->size;
+        madvise(map, size, MADV_WILLNEED);
+        u8 sum = 0;
+        for (u64 i = 0; i < size; i += page) {
+            sum += ((volatile u8 *)map)[i];
+        }
+        (void)sum;
+        __atomic_store_n(&ready, true, __ATOMIC_RELEASE);
+    }
+
+    // Number of entries per value, counts[15] being the unvisited entries.
+    // The scan is split in `threads` equal parts.
+    void Histogram(u64 counts[16], s32 threads = 1) const {
+        HistogramJob jobs[64];
+        pthread_t tids[64];
+        bool started[64];
+        threads = Min(Max(threads, 1), 64);
+        u64 chunk = RoundUp(hdr->size / threads + 1, u64(KiB(4)));
+
+        for (s32 t = 0; t < threads; t++) {
+            u64 begin = Min(t * chunk, hdr->size);
+            jobs[t] = {data + begin, Min(chunk, hdr->size - begin), {}};
+            started[t] = threads > 1 && pthread_create(&tids[t], NULL,
+                                                       HistogramWorker,
+                                                       &jobs[t]) == 0;
+            if (!started[t]) {
+                HistogramWorker(&jobs[t]);
             }
         }
+
+        memset(counts, 0, 16 * sizeof(u64));
+        for (s32 t = 0; t < threads; t++) {
+            if (started[t]) {
+                pthread_join(tids[t], NULL);
+            }
+            for (s32 k = 0; k < 16; k++) {
+                counts[k] += jobs[t].counts[k];
+            }
+        }
+    }
+
+    f64 Mean() const {
+        u64 counts[16];
+        Histogram(counts);
+        u64 sum = 0;
+        for (u64 k = 0; k < 16; k++) {
+            sum += k * counts[k];
+        }
         return sum / (f64)hdr->num_entries;
     }
 };
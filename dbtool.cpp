@@ -0,0 +1,413 @@
+#include <clocale>
+
+#include "rubiks.h"
+
+// clang-format off
+#include "deque.cpp"
+#include "bfs.cpp"
+#include "shard.cpp"
+#include "pack.cpp"
+// clang-format on
+
+/// Pattern database inspection and maintenance tool.
+///
+///   dbtool stats <db> [threads]           entries per depth and the mean
+///   dbtool verify <db> [threads]          header, completeness, reference counts
+///   dbtool diff <a> <b>                   compare two databases entry by entry
+///   dbtool lookup <db> <move>...          value of the cube after the moves
+///   dbtool convert <in> <out> <format>    nibble|byte|packed storage format
+///   dbtool reorder <in> <out> <ordering>  renumber, standard|local ordering
+///   dbtool shard <type> <dir> <k> <n>     generate shard k of n, see shard.cpp
+///   dbtool merge <dir> <out>              assemble and check the shards in dir
+
+// Number of states per depth, as found by Bfs(). The corner counts match
+// Korf's paper. The permutation counts were checked for consistency: every
+// entry has a neighbor one move closer and none two moves closer.
+struct Reference {
+    Database::Type type;
+    u64 counts[16];
+};
+
+static const Reference kReferences[] = {
+    {Database::CORNER,
+     {1, 18, 243, 2874, 28000, 205416, 1168516, 5402628, 20776176, 45391616,
+      15139616, 64736}},
+    {Database::EDGE1,
+     {1, 15, 182, 2208, 25329, 258827, 2165560, 12222708, 24596752, 3305973,
+      365}},
+    {Database::EDGE2,
+     {1, 15, 182, 2208, 25329, 258827, 2165560, 12222708, 24596752, 3305973,
+      365}},
+    {Database::PERMUTATION,
+     {1, 18, 243, 3240, 42535, 542234, 6529891, 66478628, 310957078, 94443600,
+      4132}},
+};
+
+static const char *kTypeNames[] = {"invalid", "corner", "edge1", "edge2",
+                                   "permutation"};
+static const char *kOrderingNames[] = {"standard", "local"};
+
+internal s32 DefaultThreads() { return Max(s32(sysconf(_SC_NPROCESSORS_ONLN)), 1); }
+
+internal u32 PeekMagic(const char *path) {
+    u32 magic = 0;
+    FILE *file = fopen(path, "rb");
+    if (file) {
+        if (fread(&magic, sizeof(magic), 1, file) != 1) {
+            magic = 0;
+        }
+        fclose(file);
+    }
+    return magic;
+}
+
+// Maps a database, or decodes it if it is packed.
+internal bool Open(Database &db, const char *path) {
+    if (PeekMagic(path) == MAGIC_PACKED) {
+        if (!db.LoadPacked(path, Database::INVALID, DefaultThreads())) {
+            return false;
+        }
+    } else if (!db.MemoryMapReadOnly(path)) {
+        fprintf(stderr, "'%s' is not a database\n", path);
+        return false;
+    }
+    if (db.hdr->type <= Database::INVALID ||
+        db.hdr->type > Database::PERMUTATION ||
+        db.hdr->size != db.hdr->num_entries >> 1 ||
+        !IndexerFor(db.hdr->type, db.hdr->ordering)) {
+        fprintf(stderr, "'%s' has an invalid header\n", path);
+        return false;
+    }
+    return true;
+}
+
+internal void PrintHistogram(const Database &db, const u64 counts[16]) {
+    u64 sum = 0;
+    for (s32 k = 0; k < 16; k++) {
+        if (counts[k] == 0) {
+            continue;
+        }
+        if (k < 15) {
+            sum += k * counts[k];
+        }
+        printf("%s %2d %'15lu %6.2f%%\n", k == 15 ? "unset" : "depth", k,
+               counts[k], 100.0 * counts[k] / db.hdr->num_entries);
+    }
+    u64 visited = db.hdr->num_entries - counts[15];
+    printf("mean  %0.3f over %'lu visited entries\n", sum / f64(Max(visited, u64(1))),
+           visited);
+}
+
+// From a cold page cache, the load and scan times compare reading a mapped
+// database with decoding a packed one.
+internal s32 Stats(const char *path, s32 threads) {
+    Database db;
+    f64 start = Now();
+    if (!Open(db, path)) {
+        return 1;
+    }
+    f64 loaded = Now() - start;
+
+    u64 counts[16];
+    start = Now();
+    db.Histogram(counts, threads);
+    f64 elapsed = Now() - start;
+
+    printf("%s: %'lu entries, %'lu MiB, %s ordering\n", kTypeNames[db.hdr->type],
+           db.hdr->num_entries, u64(db.hdr->size / MiB(1)),
+           kOrderingNames[db.hdr->ordering]);
+    PrintHistogram(db, counts);
+    printf("loaded in %0.3fs, scanned in %0.3fs (%0.2f GiB/s, %d threads)\n",
+           loaded, elapsed, db.hdr->size / elapsed / GiB(1), threads);
+    return 0;
+}
+
+internal s32 Verify(const char *path, s32 threads) {
+    Database db;
+    if (!Open(db, path)) {
+        return 1;
+    }
+
+    u64 counts[16];
+    db.Histogram(counts, threads);
+    PrintHistogram(db, counts);
+
+    bool ok = true;
+    Cube solved;
+    Init(solved);
+    if (counts[0] != 1 || db.Get(IndexerFor(db.hdr->type, db.hdr->ordering)(solved)) != 0) {
+        printf("FAIL: the solved state must be the only entry at depth 0\n");
+        ok = false;
+    }
+
+    if (counts[15] != 0) {
+        printf("FAIL: %'lu entries were never visited\n", counts[15]);
+        ok = false;
+    }
+
+    for (const Reference &ref : kReferences) {
+        if (ref.type != db.hdr->type) {
+            continue;
+        }
+        for (s32 k = 0; k < 16; k++) {
+            if (counts[k] != ref.counts[k]) {
+                printf("FAIL: depth %d has %'lu entries, expected %'lu\n", k,
+                       counts[k], ref.counts[k]);
+                ok = false;
+            }
+        }
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+internal s32 Diff(const char *apath, const char *bpath) {
+    Database a, b;
+    if (!Open(a, apath) || !Open(b, bpath)) {
+        return 1;
+    }
+    if (a.hdr->type != b.hdr->type || a.hdr->num_entries != b.hdr->num_entries) {
+        printf("different databases: %s (%'lu) vs %s (%'lu)\n",
+               kTypeNames[a.hdr->type], a.hdr->num_entries,
+               kTypeNames[b.hdr->type], b.hdr->num_entries);
+        return 1;
+    }
+
+    // confusion[x][y] counts the entries that are x in a and y in b
+    static u64 confusion[16][16];
+    u64 differ = 0, first = 0;
+    const u64 *pa = (const u64 *)a.data;
+    const u64 *pb = (const u64 *)b.data;
+    u64 words = a.hdr->size / sizeof(u64);
+    for (u64 i = 0; i < words; i++) {
+        if (pa[i] == pb[i]) {
+            continue;
+        }
+        for (u64 j = i * 16; j < (i + 1) * 16; j++) {
+            u8 x = a.Get(j), y = b.Get(j);
+            if (x != y) {
+                first = differ == 0 ? j : first;
+                confusion[x][y]++;
+                differ++;
+            }
+        }
+    }
+    for (u64 j = words * 16; j < a.hdr->num_entries; j++) {
+        u8 x = a.Get(j), y = b.Get(j);
+        if (x != y) {
+            first = differ == 0 ? j : first;
+            confusion[x][y]++;
+            differ++;
+        }
+    }
+
+    if (differ == 0) {
+        printf("identical\n");
+        return 0;
+    }
+
+    printf("%'lu entries differ, the first at index %'lu\n", differ, first);
+    for (s32 x = 0; x < 16; x++) {
+        for (s32 y = 0; y < 16; y++) {
+            if (confusion[x][y]) {
+                printf("  %2d -> %2d %'15lu\n", x, y, confusion[x][y]);
+            }
+        }
+    }
+    return 1;
+}
+
+internal s32 Lookup(const char *path, s32 n, char **moves) {
+    Database db;
+    if (!Open(db, path)) {
+        return 1;
+    }
+
+    Cube cube;
+    Init(cube);
+    for (s32 i = 0; i < n; i++) {
+        s32 move = 0;
+        while (move < 18 && strcmp(kNames[move], moves[i]) != 0) {
+            move++;
+        }
+        if (move == 18) {
+            fprintf(stderr, "unknown move '%s'\n", moves[i]);
+            return 1;
+        }
+        ApplyMove(cube, move);
+    }
+
+    u64 index = IndexerFor(db.hdr->type, db.hdr->ordering)(cube);
+    printf("%s[%'lu] = %u\n", kTypeNames[db.hdr->type], index, db.Get(index));
+    return 0;
+}
+
+internal s32 Convert(const char *in, const char *out, const char *format) {
+    bool packed = PeekMagic(in) == MAGIC_PACKED;
+    if (strcmp(format, "packed") == 0 ||
+        (packed && strcmp(format, "nibble") == 0)) {
+        Database db;
+        if (!Open(db, in)) {
+            return 1;
+        }
+        if (!packed) {
+            return Pack(db, out) ? 0 : 1;
+        }
+        FILE *file = fopen(out, "wb");
+        u64 size = sizeof(Database::Header) + db.hdr->size;
+        bool ok = file && fwrite(db.map, 1, size, file) == size;
+        if (file == NULL || fclose(file) != 0 || !ok) {
+            perror("write");
+            return 1;
+        }
+        return 0;
+    }
+
+    bool to_bytes = strcmp(format, "byte") == 0;
+    if (!to_bytes && strcmp(format, "nibble") != 0) {
+        fprintf(stderr, "unknown format '%s'\n", format);
+        return 1;
+    }
+
+    s32 fd = open(in, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || u64(st.st_size) < sizeof(Database::Header)) {
+        perror("open");
+        return 1;
+    }
+    u8 *map = (u8 *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    Database::Header hdr = *(Database::Header *)map;
+    const u8 *src = map + sizeof(Database::Header);
+
+    u32 from = to_bytes ? MAGIC : MAGIC_BYTES;
+    u64 size = to_bytes ? hdr.num_entries >> 1 : hdr.num_entries;
+    if (hdr.magic != from || u64(st.st_size) != sizeof(hdr) + size) {
+        fprintf(stderr, "'%s' is not a %s database\n", in,
+                to_bytes ? "nibble" : "byte");
+        return 1;
+    }
+
+    FILE *file = fopen(out, "wb");
+    if (file == NULL) {
+        perror("fopen");
+        return 1;
+    }
+    hdr.magic = to_bytes ? MAGIC_BYTES : MAGIC;
+    hdr.size = to_bytes ? hdr.num_entries : hdr.num_entries >> 1;
+    fwrite(&hdr, sizeof(hdr), 1, file);
+
+    static u8 buffer[MiB(1)];
+    u64 n = 0;
+    if (to_bytes) {
+        for (u64 i = 0; i < size; i++) {
+            buffer[n++] = src[i] & 0xf;
+            buffer[n++] = src[i] >> 4;
+            if (n == sizeof(buffer)) {
+                fwrite(buffer, 1, n, file);
+                n = 0;
+            }
+        }
+    } else {
+        for (u64 i = 0; i + 1 < size; i += 2) {
+            buffer[n++] = (src[i] & 0xf) | (src[i + 1] << 4);
+            if (n == sizeof(buffer)) {
+                fwrite(buffer, 1, n, file);
+                n = 0;
+            }
+        }
+    }
+    fwrite(buffer, 1, n, file);
+    fclose(file);
+    munmap(map, st.st_size);
+    return 0;
+}
+
+// Every entry moves to the index of its state in the other ordering.
+internal s32 Reorder(const char *in, const char *out, const char *name) {
+    Database db;
+    if (!Open(db, in)) {
+        return 1;
+    }
+    s32 ordering = 0;
+    while (ordering < 2 && strcmp(name, kOrderingNames[ordering]) != 0) {
+        ordering++;
+    }
+    Database::Type type = db.hdr->type;
+    Indexer indexer = IndexerFor(type, Database::Ordering(ordering));
+    if (ordering == 2 || !indexer) {
+        fprintf(stderr, "%s has no ordering '%s'\n", kTypeNames[type], name);
+        return 1;
+    }
+
+    Database to;
+    if (!to.Alloc(db.hdr->num_entries, type, Database::Ordering(ordering))) {
+        return 1;
+    }
+    Unranker unrank = UnrankerFor(type, db.hdr->ordering);
+    Cube cube;
+    Init(cube);
+    for (u64 i = 0; i < db.hdr->num_entries; i++) {
+        unrank(i, cube);
+        to.Update(indexer(cube), db.Get(i));
+    }
+    to.Write(out);
+    return 0;
+}
+
+internal s32 GenerateShard(const char *type, const char *dir, s32 k, s32 shards) {
+    for (s32 t = Database::CORNER; t <= Database::PERMUTATION; t++) {
+        if (strcmp(type, kTypeNames[t]) == 0) {
+            return GenerateShard(Database::Type(t), dir, k, shards) ? 0 : 1;
+        }
+    }
+    fprintf(stderr, "unknown database '%s'\n", type);
+    return 1;
+}
+
+s32 main(s32 argc, char *argv[]) {
+    setlocale(LC_NUMERIC, "");
+
+    if (argc >= 3 && strcmp(argv[1], "stats") == 0) {
+        return Stats(argv[2], argc > 3 ? atoi(argv[3]) : DefaultThreads());
+    }
+    if (argc >= 3 && strcmp(argv[1], "verify") == 0) {
+        return Verify(argv[2], argc > 3 ? atoi(argv[3]) : DefaultThreads());
+    }
+    if (argc == 4 && strcmp(argv[1], "diff") == 0) {
+        return Diff(argv[2], argv[3]);
+    }
+    if (argc >= 3 && strcmp(argv[1], "lookup") == 0) {
+        return Lookup(argv[2], argc - 3, argv + 3);
+    }
+    if (argc == 5 && strcmp(argv[1], "convert") == 0) {
+        return Convert(argv[2], argv[3], argv[4]);
+    }
+    if (argc == 5 && strcmp(argv[1], "reorder") == 0) {
+        return Reorder(argv[2], argv[3], argv[4]);
+    }
+    if (argc == 6 && strcmp(argv[1], "shard") == 0) {
+        return GenerateShard(argv[2], argv[3], atoi(argv[4]), atoi(argv[5]));
+    }
+    if (argc == 4 && strcmp(argv[1], "merge") == 0) {
+        return MergeShards(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    fprintf(stderr,
+            "usage: %s stats <db> [threads]\n"
+            "       %s verify <db> [threads]\n"
+            "       %s diff <a> <b>\n"
+            "       %s lookup <db> <move>...\n"
+            "       %s convert <in> <out> nibble|byte|packed\n"
+            "       %s reorder <in> <out> standard|local\n"
+            "       %s shard corner|edge1|edge2|permutation <dir> <k> <n>\n"
+            "       %s merge <dir> <out>\n",
+            argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+            argv[0]);
+    return 1;
+}
@@ -63,6 +63,10 @@ class Deque {
 
     u64 Size() { return size_ / sizeof(T); }
 
+    u64 Capacity() { return maxsize_ / sizeof(T); }
+
+    void Clear() { size_ = 0; }
+
    private:
     s64 maxsize_in_mem_{0};
     s64 maxsize_{0};
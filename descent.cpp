@@ -0,0 +1,144 @@
+#pragma once
+
+/// Sub-goals that a single database covers, like the corners or one group of
+/// edges, need no search. Its entries are exact distances to the sub-goal, so
+/// any move to an entry one lower is on an optimal path, and walking down the
+/// database finds an optimal sub-solution with at most 18 lookups per move.
+///
+/// A later stage must keep the sub-goals of the earlier ones solved. The
+/// largest entry of their databases is a lower bound of the distance to all
+/// of them, so IDA* with it walks down the last database as long as some
+/// move keeps the others at 0, and only searches where none does.
+
+// Appends the moves down `db` from `cube` to the solution and applies them.
+// False if the solution would exceed MAX_DEPTH or `db` is not a distance
+// table, e.g. because it is still loading.
+internal bool Descend(const Database &db, Indexer indexer, Cube &cube,
+                      Solution &solution) {
+    u8 h = db.Get(indexer(cube));
+    while (h > 0 && h != 0xf) {
+        if (solution.length + h > MAX_DEPTH) {
+            return false;
+        }
+        Cube next[18];
+        u64 index[18];
+        for (s32 move = 0; move < 18; move++) {
+            next[move] = cube;
+            ApplyMove(next[move], move);
+            index[move] = indexer(next[move]);
+            db.Prefetch(index[move]);
+        }
+        s32 move = 0;
+        while (move < 18 && db.Get(index[move]) != h - 1) {
+            move++;
+        }
+        solution.nodes += Min(move + 1, 18);
+        if (move == 18) {
+            return false;
+        }
+        solution.moves[solution.length++] = move;
+        cube = next[move];
+        h--;
+    }
+    return h == 0;
+}
+
+// The largest entry of the `n` databases for `cube`.
+internal u8 StageHeuristic(const Database *const *db, const Indexer *indexer,
+                           s32 n, Cube &cube) {
+    u8 h = 0;
+    for (s32 i = 0; i < n; i++) {
+        h = Max(db[i]->Get(indexer[i](cube)), h);
+    }
+    return h;
+}
+
+// Appends `depth` moves that take `cube` to a state where all `n` databases
+// are 0 to the solution, and applies them. False if there are none.
+internal bool StageDfs(const Database *const *db, const Indexer *indexer, s32 n,
+                       Cube &cube, s32 depth, Solution &solution) {
+    if (depth == 0) {
+        return true;
+    }
+    for (u32 valid = kValidMoves[cube.GetLastMoveIndex()]; valid;
+         valid &= valid - 1) {
+        s32 move = __builtin_ctz(valid);
+        Cube next = cube;
+        ApplyMove(next, move);
+        solution.nodes++;
+        if (1 + StageHeuristic(db, indexer, n, next) > depth) {
+            continue;
+        }
+        solution.moves[solution.length++] = move;
+        if (StageDfs(db, indexer, n, next, depth - 1, solution)) {
+            cube = next;
+            return true;
+        }
+        solution.length--;
+    }
+    return false;
+}
+
+// Appends the shortest moves from `cube` to a state where all `n` databases
+// are 0 to the solution and applies them. False if the solution would exceed
+// MAX_DEPTH.
+internal bool DescendJointly(const Database *const *db, const Indexer *indexer,
+                             s32 n, Cube &cube, Solution &solution) {
+    // kValidMoves only prunes within the stage, the last move of the one
+    // before must not restrict its first
+    cube.SetLastMoveIndex(0);
+    u8 h = StageHeuristic(db, indexer, n, cube);
+    for (s32 depth = h; solution.length + depth <= MAX_DEPTH; depth++) {
+        if (StageDfs(db, indexer, n, cube, depth, solution)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Solution Solver::SolveSubgoal(Cube cube, Database::Type goal) const {
+    return SolveStages(cube, &goal, 1);
+}
+
+Solution Solver::SolveStages(Cube cube, const Database::Type *goals, s32 n,
+                             s32 *ends) const {
+    Solution solution;
+    solution.length = 0;
+    // the databases of the stages so far, each once
+    const Database *db[NUM_DATABASES];
+    Indexer indexer[NUM_DATABASES];
+    s32 m = 0;
+    for (s32 i = 0; i < n; i++) {
+        if (goals[i] <= Database::INVALID || goals[i] > Database::PERMUTATION) {
+            solution.length = -1;
+            break;
+        }
+        const Database &stage = dbs_.Get(goals[i] - Database::CORNER);
+        if (!stage.Ready()) {
+            solution.length = -1;
+            break;
+        }
+        s32 k = 0;
+        while (k < m && db[k] != &stage) {
+            k++;
+        }
+        // the sub-goal of an earlier stage is still solved
+        if (k == m) {
+            db[m] = &stage;
+            indexer[m++] = IndexerFor(goals[i], stage.hdr->ordering);
+            bool solved = m == 1
+                              ? Descend(stage, indexer[0], cube, solution)
+                              : DescendJointly(db, indexer, m, cube, solution);
+            if (!solved) {
+                solution.length = -1;
+                break;
+            }
+        }
+        if (ends) {
+            ends[i] = solution.length;
+        }
+    }
+    // every stage is optimal, together they are only when there is one
+    solution.optimal = solution.length >= 0 && n == 1;
+    return solution;
+}
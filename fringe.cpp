@@ -0,0 +1,127 @@
+#pragma once
+
+/// Fringe search: every IDA* iteration regenerates the whole tree of the
+/// previous one before it reaches new nodes. Instead we keep the children that
+/// an iteration cut off, with their heuristic, and the next iteration continues
+/// from them. Only the fringe and one node per expanded state, to trace a
+/// solution back to the root, are kept. The fringe grows with the effective
+/// branching factor every iteration, so it is given a memory cap, after which
+/// the search goes back to plain IDA*.
+
+// Search::Dfs() result when the fringe exceeded its cap.
+#define FRINGE_FULL 253
+// Nodes are stored as parent << FRINGE_MOVE_BITS | move.
+#define FRINGE_MOVE_BITS 5
+#define FRINGE_MAX_NODES (1u << (32 - FRINGE_MOVE_BITS))
+// Entries whose lookups are prefetched together.
+#define FRINGE_BATCH 16
+
+struct FringeEntry {
+    Cube cube;
+    // the node of the parent
+    u32 parent;
+    u8 g;
+    // a lower bound, lookups stop once a child exceeds the bound
+    u8 h;
+};
+
+// Arrays are reserved at the size of the whole cap, pages are only backed
+// once they are touched, by huge pages where possible.
+internal void *Reserve(u64 bytes) {
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(p, bytes, MADV_HUGEPAGE);
+    return p;
+}
+
+struct Fringe {
+    u64 limit{0};
+    // bytes of the arrays that were ever used, which stay backed
+    u64 used{0};
+    // the entries the current iteration continues from and those it cuts off
+    FringeEntry *now{nullptr};
+    FringeEntry *next{nullptr};
+    u64 num_now{0}, num_next{0};
+    u64 now_touched{0}, next_touched{0};
+    u32 *nodes{nullptr};
+    u64 num_nodes{0};
+
+    ~Fringe() { Free(); }
+
+    // Starts over with just the root as node 0.
+    bool Reset(u64 bytes) {
+        Free();
+        limit = bytes;
+        now = (FringeEntry *)Reserve(limit);
+        next = (FringeEntry *)Reserve(limit);
+        nodes = (u32 *)Reserve(limit);
+        if (!now || !next || !nodes) {
+            Free();
+            return false;
+        }
+        return AddNode(0, 0) == 0;
+    }
+
+    void Free() {
+        FringeEntry *entries[] = {now, next};
+        for (FringeEntry *e : entries) {
+            if (e) {
+                munmap(e, limit);
+            }
+        }
+        if (nodes) {
+            munmap(nodes, limit);
+        }
+        now = next = nullptr;
+        nodes = nullptr;
+        num_now = num_next = num_nodes = 0;
+        now_touched = next_touched = 0;
+        used = 0;
+    }
+
+    // The node of a state that is expanded, FRINGE_MAX_NODES if full.
+    u32 AddNode(u32 parent, u8 move) {
+        if (num_nodes == FRINGE_MAX_NODES || used + sizeof(u32) > limit) {
+            return FRINGE_MAX_NODES;
+        }
+        used += sizeof(u32);
+        nodes[num_nodes] = parent << FRINGE_MOVE_BITS | move;
+        return num_nodes++;
+    }
+
+    bool Keep(const Cube &cube, u32 parent, u8 g, u8 h) {
+        if (num_next == next_touched) {
+            if (used + sizeof(FringeEntry) > limit) {
+                return false;
+            }
+            used += sizeof(FringeEntry);
+            next_touched++;
+        }
+        next[num_next++] = {cube, parent, g, h};
+        return true;
+    }
+
+    // The cut off entries become the ones the next iteration starts from.
+    void Advance() {
+        Swap(now, next);
+        Swap(now_touched, next_touched);
+        num_now = num_next;
+        num_next = 0;
+    }
+
+    // The moves from the root to `node`, returns their number.
+    s32 Trace(u32 node, u8 *moves) const {
+        s32 n = 0;
+        for (u32 i = node; i != 0; i = nodes[i] >> FRINGE_MOVE_BITS) {
+            n++;
+        }
+        s32 k = n;
+        for (u32 i = node; i != 0; i = nodes[i] >> FRINGE_MOVE_BITS) {
+            moves[--k] = nodes[i] & ((1u << FRINGE_MOVE_BITS) - 1);
+        }
+        return n;
+    }
+};
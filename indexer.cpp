@@ -1,7 +1,9 @@
+#pragma once
+
 /// This work is taken from Benjamin Botto's work on database indexing at:
 /// https://medium.com/@benjamin.botto/sequentially-indexing-permutations-a-linear-algorithm-for-computing-lexicographic-rank-a22220ffd6e3
 /// and adapted to suit our needs
-u64 Factorial(s32 n) {
+constexpr u64 Factorial(s32 n) {
     if (n <= 1) {
         return 1;
     }
@@ -14,9 +16,9 @@ u64 Factorial(s32 n) {
     return f;
 }
 
-u64 Pick(s32 n, s32 k) { return Factorial(n) / Factorial(n - k); }
+constexpr u64 Pick(s32 n, s32 k) { return Factorial(n) / Factorial(n - k); }
 
-u64 Power(s32 x, s32 y) {
+constexpr u64 Power(s32 x, s32 y) {
     if (y == 0) {
         return 1;
     }
@@ -31,47 +33,90 @@ u64 Power(s32 x, s32 y) {
 
 template <u32 N, u32 K = N>
 class PermutationIndexer {
-    u32 bitcount_[(1 << N) - 1]{};
     u32 factorials_[K]{};
 
    public:
-    PermutationIndexer() {
-        for (u32 i = 0; i < (1 << N) - 1; ++i) {
-            bitcount_[i] = __builtin_popcount(i);
-        }
-
+    constexpr PermutationIndexer() {
         for (u32 i = 0; i < K; ++i) {
             factorials_[i] = Pick(N - 1 - i, K - 1 - i);
         }
     }
 
     u64 Index(const u8 perm[K]) const {
-        // This will hold the Lehmer code (in a factorial number system).
-        u32 lehmer[K];
-        // Set of "seen" digits in the permutation.
+        // Set of "seen" digits in the permutation, digit d is bit d.
         u32 seen = 0ul;
-        // The first digit of the Lehmer code is always the first digit of
-        // the permutation.
-        lehmer[0] = perm[0];
-        // Mark the digit as seen (bitset uses right-to-left indexing).
-        seen |= 1u << (N - 1 - perm[0]);
-
-        for (u32 i = 1; i < K; ++i) {
-            seen |= 1u << (N - 1 - perm[i]);
-
-            // The number of "seen" digits to the left of this digit is the
-            // count of ones left of this digit.
-            u32 count = bitcount_[seen >> (N - perm[i])];
-            lehmer[i] = perm[i] - count;
-        }
-
-        // Convert the Lehmer code to base-10.
         u64 index = 0;
 
         for (u32 i = 0; i < K; ++i) {
-            index += lehmer[i] * factorials_[i];
+            // The number of "seen" digits smaller than this digit is a single
+            // popcnt, so we no longer keep a 2^N entry bitcount table around.
+            // Subtracting it gives the Lehmer digit (in a factorial number
+            // system), which we convert to base-10 as we go.
+            u32 count = __builtin_popcount(seen & ((1u << perm[i]) - 1));
+            seen |= 1u << perm[i];
+            index += (perm[i] - count) * factorials_[i];
         }
 
         return index;
     }
+
+    /// Inverse of Index(). Every Lehmer digit selects the digit-th smallest
+    /// value that is not used yet.
+    void Unrank(u64 index, u8 perm[K]) const {
+        u32 unused = (1u << N) - 1;
+        for (u32 i = 0; i < K; ++i) {
+            u32 digit = index / factorials_[i];
+            index -= u64(digit) * factorials_[i];
+            u32 x = unused;
+            for (u32 k = 0; k < digit; ++k) {
+                x &= x - 1;
+            }
+            perm[i] = __builtin_ctz(x);
+            unused &= ~(1u << perm[i]);
+        }
+    }
+
+    /// Ranks n permutations at once. The permutations are stored as
+    /// structure-of-arrays: digit i of permutation j is perm[i * stride + j].
+    /// With AVX2 eight permutations are ranked in lockstep, one per 32 bit
+    /// lane, by counting the smaller digits to the left with compares instead
+    /// of the seen-bitset. Every index fits in 32 bits as Pick(12, 12) < 2^32.
+    void IndexBatch(const u8 *perm, u32 stride, u32 n, u64 *out) const {
+        u32 j = 0;
+#ifdef __AVX2__
+        for (; j + 8 <= n; j += 8) {
+            __m256i digits[K];
+            for (u32 i = 0; i < K; ++i) {
+                __m128i d = _mm_loadl_epi64((const __m128i *)(perm + i * stride + j));
+                digits[i] = _mm256_cvtepu8_epi32(d);
+            }
+
+            __m256i index = _mm256_setzero_si256();
+            for (u32 i = 0; i < K; ++i) {
+                // lehmer = digit - #{k < i : digit[k] < digit}, the compare
+                // yields -1 for every smaller digit to the left
+                __m256i lehmer = digits[i];
+                for (u32 k = 0; k < i; ++k) {
+                    lehmer = _mm256_add_epi32(
+                        lehmer, _mm256_cmpgt_epi32(digits[i], digits[k]));
+                }
+                __m256i f = _mm256_set1_epi32(factorials_[i]);
+                index = _mm256_add_epi32(index, _mm256_mullo_epi32(lehmer, f));
+            }
+
+            _mm256_storeu_si256((__m256i *)(out + j),
+                                _mm256_cvtepu32_epi64(_mm256_castsi256_si128(index)));
+            _mm256_storeu_si256((__m256i *)(out + j + 4),
+                                _mm256_cvtepu32_epi64(_mm256_extracti128_si256(index, 1)));
+        }
+#endif
+        // scalar fallback, also handles the tail of the batch
+        for (; j < n; ++j) {
+            u8 p[K];
+            for (u32 i = 0; i < K; ++i) {
+                p[i] = perm[i * stride + j];
+            }
+            out[j] = Index(p);
+        }
+    }
 };
\ No newline at end of file
@@ -1,3 +1,5 @@
+#pragma once
+
 /// A Rubik's Cube model (3x3x3) based on Richard E. Korf's paper.
 ///
 ///   Finding Optimal Solutions to Rubik's Cube
@@ -79,99 +81,99 @@ struct Cube {
     static constexpr u32 EDGE_ORIENTATION = 4;
 
     // Helpers to extract corner sub-fields
-    inline u32 GetCornerCubie(Corner corner) const {
+    constexpr u32 GetCornerCubie(Corner corner) const {
         const u32 shift = corner * CORNER_BITS;
         constexpr u64 mask = 0b111111ull;
         return static_cast<u32>((corners >> shift) & mask);
     }
 
-    inline void SetCornerCubie(Corner corner, u32 cubie) {
+    constexpr void SetCornerCubie(Corner corner, u32 cubie) {
         const u32 shift = corner * CORNER_BITS;
         constexpr u64 mask = 0b111111ull;
         corners &= ~(mask << shift);
         corners |= (static_cast<u64>(cubie) & mask) << shift;
     }
 
-    inline u32 GetCornerPos(Corner corner) const {
+    constexpr u32 GetCornerPos(Corner corner) const {
         const u32 shift = corner * CORNER_BITS + CORNER_POSITION;
         constexpr u64 mask = 0b111ull;
         return static_cast<u32>((corners >> shift) & mask);
     }
 
-    inline void SetCornerPos(Corner corner, u32 pos) {
+    constexpr void SetCornerPos(Corner corner, u32 pos) {
         const u32 shift = corner * CORNER_BITS + CORNER_POSITION;
         constexpr u64 mask = 0b111ull;
         corners &= ~(mask << shift);
         corners |= (static_cast<u64>(pos) & mask) << shift;
     }
 
-    inline u32 GetCornerOri(Corner corner) const {
+    constexpr u32 GetCornerOri(Corner corner) const {
         const u32 shift = corner * CORNER_BITS + CORNER_ORIENTATION;
         constexpr u64 mask = 0b111ull;
         return static_cast<u32>((corners >> shift) & mask);
     }
 
-    inline void SetCornerOri(Corner corner, u32 ori) {
+    constexpr void SetCornerOri(Corner corner, u32 ori) {
         const u32 shift = corner * CORNER_BITS + CORNER_ORIENTATION;
         constexpr u64 mask = 0b111ull;
         corners &= ~(mask << shift);
         corners |= (static_cast<u64>(ori) & mask) << shift;
     }
 
-    inline u32 GetLastMoveIndex() const {
+    constexpr u32 GetLastMoveIndex() const {
         return static_cast<u32>((corners >> LAST_MOVE_SHIFT) & LAST_MOVE_MASK);
     }
 
-    inline void SetLastMoveIndex(u32 move) {
+    constexpr void SetLastMoveIndex(u32 move) {
         corners &= ~(LAST_MOVE_MASK << LAST_MOVE_SHIFT);
         corners |= (static_cast<u64>(move) & LAST_MOVE_MASK) << LAST_MOVE_SHIFT;
     }
 
-    inline u32 GetEdgeCubie(Edge edge) const {
+    constexpr u32 GetEdgeCubie(Edge edge) const {
         const u32 shift = edge * EDGE_BITS;
         constexpr u64 mask = 0b11111ull;
         return static_cast<u32>((edges >> shift) & mask);
     }
 
-    inline void SetEdgeCubie(Edge edge, u32 cubie) {
+    constexpr void SetEdgeCubie(Edge edge, u32 cubie) {
         const u32 shift = edge * EDGE_BITS;
         constexpr u64 mask = 0b11111ull;
         edges &= ~(mask << shift);
         edges |= (static_cast<u64>(cubie) & mask) << shift;
     }
 
-    inline u32 GetEdgePos(Edge edge) const {
+    constexpr u32 GetEdgePos(Edge edge) const {
         const u32 shift = edge * EDGE_BITS + EDGE_POSITION;
         constexpr u64 mask = 0b1111ull;
         return static_cast<u32>((edges >> shift) & mask);
     }
 
-    inline void SetEdgePos(Edge edge, u32 pos) {
+    constexpr void SetEdgePos(Edge edge, u32 pos) {
         const u32 shift = edge * EDGE_BITS + EDGE_POSITION;
         constexpr u64 mask = 0b1111ull;
         edges &= ~(mask << shift);
         edges |= (static_cast<u64>(pos) & mask) << shift;
     }
 
-    inline u32 GetEdgeOri(Edge edge) const {
+    constexpr u32 GetEdgeOri(Edge edge) const {
         const u32 shift = edge * EDGE_BITS + EDGE_ORIENTATION;
         constexpr u64 mask = 0b1ull;
         return static_cast<u32>((edges >> shift) & mask);
     }
 
-    inline void SetEdgeOri(Edge edge, u32 ori) {
+    constexpr void SetEdgeOri(Edge edge, u32 ori) {
         const u32 shift = edge * EDGE_BITS + EDGE_ORIENTATION;
         constexpr u64 mask = 0b1ull;
         edges &= ~(mask << shift);
         edges |= (static_cast<u64>(ori) & mask) << shift;
     }
 
-    inline void EdgeFlipOri(Edge edge) {
+    constexpr void EdgeFlipOri(Edge edge) {
         const u32 shift = edge * EDGE_BITS + EDGE_ORIENTATION;
         edges ^= 1ull << shift;
     }
 
-    inline void Update(Corner corner, u32 n) {
+    constexpr void Update(Corner corner, u32 n) {
         auto ori = GetCornerOri(corner);
         ori += n;
         ori %= 3;
@@ -186,7 +188,7 @@ struct Cube {
     }
 };
 
-internal void Init(Cube &c) {
+internal constexpr void Init(Cube &c) {
     c.corners = c.edges = 0ull;
 
     for (s32 i = 0; i < 8; i++) {
@@ -337,7 +339,7 @@ internal void PrettyPrint(Cube &c) {
     printf("\n");
 }
 
-internal inline void L(Cube &c) {
+internal constexpr void L(Cube &c) {
     auto tmp = c.GetCornerCubie(DLB);
     c.SetCornerCubie(DLB, c.GetCornerCubie(DLF));
     c.SetCornerCubie(DLF, c.GetCornerCubie(ULF));
@@ -356,18 +358,18 @@ internal inline void L(Cube &c) {
     c.SetEdgeCubie(UL, tmp);
 }
 
-internal inline void L2(Cube &c) {
+internal constexpr void L2(Cube &c) {
     L(c);
     L(c);
 }
 
-internal inline void Lprime(Cube &c) {
+internal constexpr void Lprime(Cube &c) {
     L(c);
     L(c);
     L(c);
 }
 
-internal inline void R(Cube &c) {
+internal constexpr void R(Cube &c) {
     auto tmp = c.GetCornerCubie(DRB);
     c.SetCornerCubie(DRB, c.GetCornerCubie(URB));
     c.SetCornerCubie(URB, c.GetCornerCubie(URF));
@@ -386,18 +388,18 @@ internal inline void R(Cube &c) {
     c.SetEdgeCubie(DR, tmp);
 }
 
-internal inline void R2(Cube &c) {
+internal constexpr void R2(Cube &c) {
     R(c);
     R(c);
 }
 
-internal inline void Rprime(Cube &c) {
+internal constexpr void Rprime(Cube &c) {
     R(c);
     R(c);
     R(c);
 }
 
-internal inline void U(Cube &c) {
+internal constexpr void U(Cube &c) {
     auto tmp = c.GetCornerCubie(ULF);
     c.SetCornerCubie(ULF, c.GetCornerCubie(URF));
     c.SetCornerCubie(URF, c.GetCornerCubie(URB));
@@ -411,18 +413,18 @@ internal inline void U(Cube &c) {
     c.SetEdgeCubie(UB, tmp);
 }
 
-internal inline void U2(Cube &c) {
+internal constexpr void U2(Cube &c) {
     U(c);
     U(c);
 }
 
-internal inline void Uprime(Cube &c) {
+internal constexpr void Uprime(Cube &c) {
     U(c);
     U(c);
     U(c);
 }
 
-internal inline void D(Cube &c) {
+internal constexpr void D(Cube &c) {
     auto tmp = c.GetCornerCubie(DLB);
     c.SetCornerCubie(DLB, c.GetCornerCubie(DRB));
     c.SetCornerCubie(DRB, c.GetCornerCubie(DRF));
@@ -436,18 +438,18 @@ internal inline void D(Cube &c) {
     c.SetEdgeCubie(DL, tmp);
 }
 
-internal inline void D2(Cube &c) {
+internal constexpr void D2(Cube &c) {
     D(c);
     D(c);
 }
 
-internal inline void Dprime(Cube &c) {
+internal constexpr void Dprime(Cube &c) {
     D(c);
     D(c);
     D(c);
 }
 
-internal inline void F(Cube &c) {
+internal constexpr void F(Cube &c) {
     auto tmp = c.GetCornerCubie(ULF);
     c.SetCornerCubie(ULF, c.GetCornerCubie(DLF));
     c.SetCornerCubie(DLF, c.GetCornerCubie(DRF));
@@ -471,18 +473,18 @@ internal inline void F(Cube &c) {
     c.EdgeFlipOri(FR);
 }
 
-internal inline void F2(Cube &c) {
+internal constexpr void F2(Cube &c) {
     F(c);
     F(c);
 }
 
-internal inline void Fprime(Cube &c) {
+internal constexpr void Fprime(Cube &c) {
     F(c);
     F(c);
     F(c);
 }
 
-internal inline void B(Cube &c) {
+internal constexpr void B(Cube &c) {
     auto tmp = c.GetCornerCubie(ULB);
     c.SetCornerCubie(ULB, c.GetCornerCubie(URB));
     c.SetCornerCubie(URB, c.GetCornerCubie(DRB));
@@ -506,45 +508,155 @@ internal inline void B(Cube &c) {
     c.EdgeFlipOri(BL);
 }
 
-internal inline void B2(Cube &c) {
+internal constexpr void B2(Cube &c) {
     B(c);
     B(c);
 }
 
-internal inline void Bprime(Cube &c) {
+internal constexpr void Bprime(Cube &c) {
     B(c);
     B(c);
     B(c);
 }
 
 using MoveFunc = void (*)(Cube &);
-static const char *kNames[] = {"R", "R2", "R'", "L", "L2", "L'",
-                               "U", "U2", "U'", "D", "D2", "D'",
-                               "F", "F2", "F'", "B", "B2", "B'"};
-static const MoveFunc kMoves[] = {&R, &R2, &Rprime, &L, &L2, &Lprime,
-                                  &U, &U2, &Uprime, &D, &D2, &Dprime,
-                                  &F, &F2, &Fprime, &B, &B2, &Bprime};
+static const char *const kNames[] = {"R", "R2", "R'", "L", "L2", "L'",
+                                     "U", "U2", "U'", "D", "D2", "D'",
+                                     "F", "F2", "F'", "B", "B2", "B'"};
+static constexpr MoveFunc kMoves[] = {&R, &R2, &Rprime, &L, &L2, &Lprime,
+                                      &U, &U2, &Uprime, &D, &D2, &Dprime,
+                                      &F, &F2, &Fprime, &B, &B2, &Bprime};
+
+struct ValidMoves {
+    u32 mask[19]{};
+
+    constexpr u32 operator[](u32 last) const { return mask[last]; }
+};
 
 // after the first move we do not allow moves of the same kind. E.g. after move
 // R, we disable R,R',2R. We only allow moves of the opposing faces
-// in one strict order. See scripts/genmoves.py
-static const u32 kValidMoves[] = {
-    0b111111111111111111, 0b111111111111111000, 0b111111111111111000,
-    0b111111111111111000, 0b111111111111000000, 0b111111111111000000,
-    0b111111111111000000, 0b111111111000111111, 0b111111111000111111,
-    0b111111111000111111, 0b111111000000111111, 0b111111000000111111,
-    0b111111000000111111, 0b111000111111111111, 0b111000111111111111,
-    0b111000111111111111, 0b000000111111111111, 0b000000111111111111,
-    0b000000111111111111};
-
-internal void ApplyMove(Cube &c, s32 move) {
-    kMoves[move](c);
+// in one strict order (R before L, U before D, F before B). Index 0 means no
+// move was made yet. This is what scripts/genmoves.py used to print.
+internal constexpr ValidMoves GenerateValidMoves() {
+    constexpr u32 all = (1u << 18) - 1;
+    ValidMoves v;
+    v.mask[0] = all;
+    for (u32 move = 0; move < 18; move++) {
+        u32 face = move / 3;
+        u32 valid = all & ~(0b111u << (face * 3));
+        if (face & 1) {
+            valid &= ~(0b111u << ((face - 1) * 3));
+        }
+        v.mask[move + 1] = valid;
+    }
+    return v;
+}
+
+internal constexpr ValidMoves kValidMoves = GenerateValidMoves();
+
+// Every move cycles exactly 4 corners and 4 edges. A move writes the cubie at
+// slot `from` into slot `slot`, twisting the corner or flipping the edge.
+struct MoveTable {
+    u8 corner_slot[4]{};
+    u8 corner_from[4]{};
+    u8 corner_twist[4]{};
+    u8 edge_slot[4]{};
+    u8 edge_from[4]{};
+    u8 edge_flip[4]{};
+};
+
+// Derive the tables by applying each move to the solved cube, where every
+// cubie id equals the slot it came from.
+internal constexpr void GenerateMoveTables(MoveTable (&tables)[18]) {
+    for (u32 move = 0; move < 18; move++) {
+        Cube c{};
+        Init(c);
+        kMoves[move](c);
+
+        MoveTable &t = tables[move];
+        u32 n = 0;
+        for (u32 i = 0; i < 8; i++) {
+            u32 from = c.GetCornerPos(Corner(i));
+            u32 twist = c.GetCornerOri(Corner(i));
+            if (from != i || twist != 0) {
+                t.corner_slot[n] = i;
+                t.corner_from[n] = from;
+                t.corner_twist[n] = twist;
+                n++;
+            }
+        }
+
+        n = 0;
+        for (u32 i = 0; i < 12; i++) {
+            u32 from = c.GetEdgePos(Edge(i));
+            u32 flip = c.GetEdgeOri(Edge(i));
+            if (from != i || flip != 0) {
+                t.edge_slot[n] = i;
+                t.edge_from[n] = from;
+                t.edge_flip[n] = flip;
+                n++;
+            }
+        }
+    }
+}
+
+struct MoveTables {
+    MoveTable move[18]{};
+
+    constexpr MoveTables() { GenerateMoveTables(move); }
+    constexpr const MoveTable &operator[](u32 i) const { return move[i]; }
+};
+
+internal constexpr MoveTables kMoveTables{};
+
+internal inline void ApplyMove(Cube &c, s32 move) {
+    const MoveTable &m = kMoveTables[move];
+    u32 corners[4], edges[4];
+    for (s32 i = 0; i < 4; i++) {
+        corners[i] = c.GetCornerCubie(Corner(m.corner_from[i]));
+        edges[i] = c.GetEdgeCubie(Edge(m.edge_from[i]));
+    }
+
+    for (s32 i = 0; i < 4; i++) {
+        u32 ori = (corners[i] >> Cube::CORNER_ORIENTATION) + m.corner_twist[i];
+        ori -= ori >= 3 ? 3 : 0;
+        u32 pos = corners[i] & 0b111;
+        c.SetCornerCubie(Corner(m.corner_slot[i]),
+                         pos | (ori << Cube::CORNER_ORIENTATION));
+        c.SetEdgeCubie(Edge(m.edge_slot[i]),
+                       edges[i] ^ (u32(m.edge_flip[i]) << Cube::EDGE_ORIENTATION));
+    }
     c.SetLastMoveIndex(move + 1);
 }
 
+// The cube whose moves undo those of `c`: the cubie in slot i of `c` sits in
+// slot s, so in the inverse cubie i sits in slot s, with the opposite twist.
+// Both are solved in the same number of moves.
+internal Cube Inverse(const Cube &c) {
+    Cube out;
+    out.corners = out.edges = 0;
+    for (u32 i = 0; i < 8; i++) {
+        Corner s = Corner(c.GetCornerPos(Corner(i)));
+        u32 ori = c.GetCornerOri(Corner(i));
+        out.SetCornerPos(s, i);
+        out.SetCornerOri(s, ori ? 3 - ori : 0);
+    }
+    for (u32 i = 0; i < 12; i++) {
+        Edge s = Edge(c.GetEdgePos(Edge(i)));
+        out.SetEdgePos(s, i);
+        out.SetEdgeOri(s, c.GetEdgeOri(Edge(i)));
+    }
+    return out;
+}
+
+// The indexer tables are built at compile time, so the index functions below
+// do not pay for a static initialization guard on every call.
+internal constexpr PermutationIndexer<12, PICKED> kEdgeIndexer{};
+internal constexpr PermutationIndexer<8> kCornerIndexer{};
+internal constexpr PermutationIndexer<12> kPermutationIndexer{};
+
 template <s32 K>
 internal u64 EdgeIndex(Cube &c, u32 start) {
-    static PermutationIndexer<12, PICKED> indexer;
     assert(start + K <= 12);
 
     u8 perm[K];
@@ -572,18 +684,17 @@ internal u64 EdgeIndex(Cube &c, u32 start) {
         }
     }
 
-    u64 position = indexer.Index(perm);
+    u64 position = kEdgeIndexer.Index(perm);
     return position * (1ull << K) + orientation;
 }
 
 internal u64 CornerIndex(Cube &c) {
-    static PermutationIndexer<8> indexer;
     u8 perm[8];
     for (s32 i = 0; i < 8; i++) {
         perm[i] = c.GetCornerPos(Corner(i));
     }
 
-    u32 position = indexer.Index(perm);
+    u32 position = kCornerIndexer.Index(perm);
     u32 orientation = 0;
     u32 n = 1;
     for (s32 i = 0; i < 7; i++) {
@@ -595,10 +706,212 @@ internal u64 CornerIndex(Cube &c) {
 }
 
 internal u64 PermutationIndex(Cube &c) {
-    static PermutationIndexer<12> indexer;
     u8 perm[12];
     for (s32 i = 0; i < 12; i++) {
         perm[i] = c.GetEdgePos(Edge(i));
     }
-    return indexer.Index(perm);
-}
\ No newline at end of file
+    return kPermutationIndexer.Index(perm);
+}
+
+// The LOCAL ordering of the corner database. U and D turns neither twist the
+// corners nor move them out of their layer, so the index keeps the set of
+// cubies in the U layer (70 sets) and the twist per cubie (3^7) in its high
+// digits, and the order within the U and D layers (24 each) in its low digits.
+// The children of U and D turns then lie within 576 entries of their parent,
+// in the same or a nearby cache line, where the standard index sends every
+// child to a different page.
+struct CornerSubsets {
+    u8 rank[256];
+    u8 mask[70];
+};
+
+internal constexpr CornerSubsets MakeCornerSubsets() {
+    CornerSubsets subsets{};
+    u32 n = 0;
+    for (u32 mask = 0; mask < 256; mask++) {
+        if (__builtin_popcount(mask) == 4) {
+            subsets.rank[mask] = n;
+            subsets.mask[n++] = mask;
+        }
+    }
+    return subsets;
+}
+
+internal constexpr CornerSubsets kCornerSubsets = MakeCornerSubsets();
+internal constexpr PermutationIndexer<4> kLayerIndexer{};
+
+internal u64 CornerLocalIndex(Cube &c) {
+    u8 cubie[8], twist[8];
+    u32 up = 0;
+    for (s32 i = 0; i < 8; i++) {
+        cubie[i] = c.GetCornerPos(Corner(i));
+        twist[cubie[i]] = c.GetCornerOri(Corner(i));
+        up |= i < 4 ? 1u << cubie[i] : 0;
+    }
+
+    // the order within a layer, as the ranks of its cubies within the layer
+    u8 order[8];
+    for (s32 i = 0; i < 8; i++) {
+        u32 layer = i < 4 ? up : ~up & 0xff;
+        order[i] = __builtin_popcount(layer & ((1u << cubie[i]) - 1));
+    }
+
+    u32 orientation = 0;
+    u32 n = 1;
+    for (s32 i = 0; i < 7; i++) {
+        orientation += twist[i] * n;
+        n *= 3;
+    }
+
+    u64 index = kCornerSubsets.rank[up] * 2187ull + orientation;
+    index = index * 24 + kLayerIndexer.Index(order);
+    return index * 24 + kLayerIndexer.Index(order + 4);
+}
+
+// Orientation-only patterns of 3^7 and 2^11 entries. The orientation of the
+// last corner and edge follow from the others.
+internal u32 CornerOrientationIndex(const Cube &c) {
+    u32 orientation = 0;
+    u32 n = 1;
+    for (s32 i = 0; i < 7; i++) {
+        orientation += c.GetCornerOri(Corner(i)) * n;
+        n *= 3;
+    }
+    return orientation;
+}
+
+internal u32 EdgeOrientationIndex(const Cube &c) {
+    u32 orientation = 0;
+    for (s32 i = 0; i < 11; i++) {
+        orientation |= c.GetEdgeOri(Edge(i)) << i;
+    }
+    return orientation;
+}
+
+// The inverses of the index functions above build a cube that has the given
+// index. Cubies that are not part of the pattern get the remaining slots.
+template <s32 K>
+internal void EdgeUnrank(u64 index, u32 start, Cube &c) {
+    u8 perm[K];
+    kEdgeIndexer.Unrank(index >> K, perm);
+    u32 orientation = index & ((1u << K) - 1);
+
+    // the orientation bits are ordered by slot, the first slot being the
+    // highest bit
+    u32 used = 0;
+    for (s32 k = 0; k < K; k++) {
+        used |= 1u << perm[k];
+    }
+    c.edges = 0;
+    for (s32 k = 0; k < K; k++) {
+        u32 slot = perm[k];
+        u32 rank = __builtin_popcount(used & ((1u << slot) - 1));
+        c.SetEdgePos(Edge(slot), start + k);
+        c.SetEdgeOri(Edge(slot), (orientation >> (K - 1 - rank)) & 1);
+    }
+    u32 cubie = start == 0 ? K : 0;
+    for (u32 slot = 0; slot < 12; slot++) {
+        if (!(used & (1u << slot))) {
+            c.SetEdgePos(Edge(slot), cubie++);
+        }
+    }
+}
+
+internal void CornerUnrank(u64 index, Cube &c) {
+    u8 perm[8];
+    kCornerIndexer.Unrank(index / 2187, perm);
+    u32 orientation = index % 2187;
+
+    // the twist of the last corner follows from the others
+    c.corners = 0;
+    u32 sum = 0;
+    for (s32 i = 0; i < 8; i++) {
+        u32 ori = i < 7 ? orientation % 3 : (3 - sum % 3) % 3;
+        orientation /= 3;
+        sum += ori;
+        c.SetCornerPos(Corner(i), perm[i]);
+        c.SetCornerOri(Corner(i), ori);
+    }
+}
+
+internal void PermutationUnrank(u64 index, Cube &c) {
+    u8 perm[12];
+    kPermutationIndexer.Unrank(index, perm);
+    c.edges = 0;
+    for (s32 i = 0; i < 12; i++) {
+        c.SetEdgePos(Edge(i), perm[i]);
+    }
+}
+
+internal void CornerLocalUnrank(u64 index, Cube &c) {
+    u8 order[8];
+    kLayerIndexer.Unrank(index % 24, order + 4);
+    index /= 24;
+    kLayerIndexer.Unrank(index % 24, order);
+    index /= 24;
+    u32 orientation = index % 2187;
+    u32 up = kCornerSubsets.mask[index / 2187];
+
+    u8 twist[8];
+    u32 sum = 0;
+    for (s32 i = 0; i < 8; i++) {
+        twist[i] = i < 7 ? orientation % 3 : (3 - sum % 3) % 3;
+        orientation /= 3;
+        sum += twist[i];
+    }
+
+    c.corners = 0;
+    for (s32 i = 0; i < 8; i++) {
+        // the order-th smallest cubie of the layer
+        u32 layer = i < 4 ? up : ~up & 0xff;
+        for (u32 k = 0; k < order[i]; k++) {
+            layer &= layer - 1;
+        }
+        u32 cubie = __builtin_ctz(layer);
+        c.SetCornerPos(Corner(i), cubie);
+        c.SetCornerOri(Corner(i), twist[cubie]);
+    }
+}
+
+using Indexer = u64 (*)(Cube &c);
+using Unranker = void (*)(u64 index, Cube &c);
+
+// Null for an ordering that the type does not have.
+internal Indexer IndexerFor(Database::Type type,
+                            Database::Ordering ordering = Database::STANDARD) {
+    if (ordering == Database::LOCAL) {
+        return type == Database::CORNER ? CornerLocalIndex : nullptr;
+    }
+    switch (type) {
+        case Database::CORNER:
+            return [](Cube &c) { return CornerIndex(c); };
+        case Database::EDGE1:
+            return [](Cube &c) { return EdgeIndex<PICKED>(c, 0); };
+        case Database::EDGE2:
+            return [](Cube &c) { return EdgeIndex<PICKED>(c, 12 - PICKED); };
+        case Database::PERMUTATION:
+            return [](Cube &c) { return PermutationIndex(c); };
+        default:
+            return nullptr;
+    }
+}
+
+// Unrankers only set the corners or the edges, the others are left as they are.
+internal Unranker UnrankerFor(
+    Database::Type type, Database::Ordering ordering = Database::STANDARD) {
+    if (ordering == Database::LOCAL) {
+        return type == Database::CORNER ? CornerLocalUnrank : nullptr;
+    }
+    switch (type) {
+        case Database::CORNER:
+            return [](u64 i, Cube &c) { CornerUnrank(i, c); };
+        case Database::EDGE1:
+            return [](u64 i, Cube &c) { EdgeUnrank<PICKED>(i, 0, c); };
+        case Database::EDGE2:
+            return [](u64 i, Cube &c) { EdgeUnrank<PICKED>(i, 12 - PICKED, c); };
+        case Database::PERMUTATION:
+            return [](u64 i, Cube &c) { PermutationUnrank(i, c); };
+        default:
+            return nullptr;
+    }
+}
@@ -0,0 +1,342 @@
+#pragma once
+
+/// Packed databases, a compressed distribution format. The bytes of the
+/// nibble table, two entries each, are coded with one canonical Huffman code
+/// for the whole file. Most entries lie at two or three depths, so a byte
+/// takes about three bits. The table is cut into blocks that are coded
+/// independently, so the loader decodes them in parallel, each thread straight
+/// into its part of the table.
+///
+///   Database::Header   magic MAGIC_PACKED, size of the decoded table
+///   PackedHeader       block size and count, code length of every byte
+///   u64[blocks + 1]    offsets of the blocks, from the end of the offsets
+///   blocks             codes packed LSB first
+
+#define MAGIC_PACKED 0xfeffc2fd
+#define PACK_BLOCK KiB(256)
+// Longer codes are flattened, so a single table lookup decodes any symbol.
+#define PACK_MAX_BITS 12
+// Decoding reads 8 bytes at a time, possibly past the end of a block.
+#define PACK_PADDING 8
+
+struct PackedHeader {
+    u32 block_size;
+    u32 num_blocks;
+    u8 lengths[256];
+};
+
+// Code lengths of a Huffman code for `freq`, a symbol that does not occur
+// gets none. Frequencies are halved until no code is longer than
+// PACK_MAX_BITS, which costs little as only very rare bytes get long codes.
+internal void HuffmanLengths(const u64 freq[256], u8 lengths[256]) {
+    u64 f[256];
+    memcpy(f, freq, sizeof(f));
+    while (true) {
+        // nodes 0..255 are the symbols, the rest are merged pairs
+        u64 weight[512];
+        s32 parent[512];
+        bool active[512] = {};
+        s32 n = 256, live = 0;
+        for (s32 i = 0; i < 256; i++) {
+            weight[i] = f[i];
+            parent[i] = -1;
+            active[i] = f[i] > 0;
+            live += active[i];
+        }
+        while (live > 1) {
+            s32 a = -1, b = -1;
+            for (s32 i = 0; i < n; i++) {
+                if (!active[i]) {
+                    continue;
+                }
+                if (a < 0 || weight[i] < weight[a]) {
+                    b = a;
+                    a = i;
+                } else if (b < 0 || weight[i] < weight[b]) {
+                    b = i;
+                }
+            }
+            active[a] = active[b] = false;
+            weight[n] = weight[a] + weight[b];
+            parent[n] = -1;
+            parent[a] = parent[b] = n;
+            active[n++] = true;
+            live--;
+        }
+
+        u8 longest = 0;
+        for (s32 i = 0; i < 256; i++) {
+            u8 len = 0;
+            for (s32 p = parent[i]; p >= 0; p = parent[p]) {
+                len++;
+            }
+            // a lone symbol still needs a bit
+            lengths[i] = f[i] > 0 ? Max(len, u8(1)) : 0;
+            longest = Max(longest, lengths[i]);
+        }
+        if (longest <= PACK_MAX_BITS) {
+            return;
+        }
+        for (s32 i = 0; i < 256; i++) {
+            f[i] = f[i] ? (f[i] + 1) / 2 : 0;
+        }
+    }
+}
+
+// Canonical codes for the lengths, bit reversed for LSB first output.
+internal void HuffmanCodes(const u8 lengths[256], u16 codes[256]) {
+    u16 code = 0;
+    for (u8 len = 1; len <= PACK_MAX_BITS; len++) {
+        for (s32 i = 0; i < 256; i++) {
+            if (lengths[i] != len) {
+                continue;
+            }
+            u16 reversed = 0;
+            for (u8 k = 0; k < len; k++) {
+                reversed |= ((code >> k) & 1) << (len - 1 - k);
+            }
+            codes[i] = reversed;
+            code++;
+        }
+        code <<= 1;
+    }
+}
+
+// Every PACK_MAX_BITS wide window of input maps to its first symbol, as
+// symbol | length << 8.
+internal void HuffmanTable(const u8 lengths[256],
+                          u16 table[1 << PACK_MAX_BITS]) {
+    u16 codes[256];
+    HuffmanCodes(lengths, codes);
+    for (s32 i = 0; i < 256; i++) {
+        for (u32 x = 0; lengths[i] && x < 1u << (PACK_MAX_BITS - lengths[i]);
+             x++) {
+            table[codes[i] | x << lengths[i]] = i | lengths[i] << 8;
+        }
+    }
+}
+
+// Codes are about three bits long, so a window usually holds several. Every
+// window maps to the up to three symbols that lie entirely within it, as
+// symbols | bits << 24 | count << 28.
+internal void MultiTable(const u8 lengths[256], u32 table[1 << PACK_MAX_BITS]) {
+    u16 single[1 << PACK_MAX_BITS];
+    HuffmanTable(lengths, single);
+    const u32 mask = (1 << PACK_MAX_BITS) - 1;
+    for (u32 w = 0; w <= mask; w++) {
+        u32 bits = 0, count = 0, symbols = 0;
+        while (count < 3) {
+            u16 e = single[(w >> bits) & mask];
+            if (bits + (e >> 8) > PACK_MAX_BITS) {
+                break;
+            }
+            symbols |= u32(e & 0xff) << (8 * count++);
+            bits += e >> 8;
+        }
+        table[w] = symbols | bits << 24 | count << 28;
+    }
+}
+
+// Decodes n bytes from `in`, which must be readable PACK_PADDING bytes past
+// the end of the codes. Every 8 byte read holds at least 56 bits, enough for
+// four windows. A window stores 4 bytes but only advances by its count, so
+// the fast loop stops 13 bytes before the end.
+internal void DecodeBlock(const u32 *table, const u8 *in, u8 *out, u64 n) {
+    const u32 mask = (1 << PACK_MAX_BITS) - 1;
+    u64 pos = 0, i = 0;
+    for (; i + 13 <= n;) {
+        u64 bits;
+        memcpy(&bits, in + (pos >> 3), 8);
+        bits >>= pos & 7;
+        for (s32 k = 0; k < 4; k++) {
+            u32 e = table[bits & mask];
+            memcpy(out + i, &e, 4);
+            i += e >> 28;
+            bits >>= (e >> 24) & 0xf;
+            pos += (e >> 24) & 0xf;
+        }
+    }
+    while (i < n) {
+        u64 bits;
+        memcpy(&bits, in + (pos >> 3), 8);
+        u32 e = table[(bits >> (pos & 7)) & mask];
+        for (u32 k = 0; k < e >> 28 && i < n; k++) {
+            out[i++] = u8(e >> (8 * k));
+        }
+        pos += (e >> 24) & 0xf;
+    }
+}
+
+struct UnpackJob {
+    s32 fd;
+    const PackedHeader *packed;
+    const u64 *offsets;
+    u64 base;
+    const u32 *table;
+    u8 *data;
+    u64 size;
+    u32 next;
+    bool ok;
+};
+
+// Claims blocks until none are left, reading each with its own pread so the
+// threads keep several reads in flight.
+internal void *UnpackWorker(void *arg) {
+    UnpackJob *job = (UnpackJob *)arg;
+    u64 capacity = 0;
+    u8 *buffer = NULL;
+    while (true) {
+        u32 b = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (b >= job->packed->num_blocks) {
+            break;
+        }
+        u64 length = job->offsets[b + 1] - job->offsets[b];
+        if (length + PACK_PADDING > capacity) {
+            free(buffer);
+            capacity = length + PACK_PADDING;
+            buffer = (u8 *)malloc(capacity);
+        }
+        u64 begin = u64(b) * job->packed->block_size;
+        u64 n = Min(u64(job->packed->block_size), job->size - begin);
+        u64 offset = job->base + job->offsets[b];
+        if (buffer == NULL ||
+            pread(job->fd, buffer, length, offset) != s64(length)) {
+            job->ok = false;
+            break;
+        }
+        memset(buffer + length, 0, PACK_PADDING);
+        DecodeBlock(job->table, buffer, job->data + begin, n);
+    }
+    free(buffer);
+    return NULL;
+}
+
+bool Database::LoadPacked(const char *path, Type type, s32 threads) {
+    s32 fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return false;
+    }
+    Header h;
+    PackedHeader packed = {};
+    bool ok = pread(fd, &h, sizeof(h), 0) == sizeof(h) &&
+              pread(fd, &packed, sizeof(packed), sizeof(h)) == sizeof(packed) &&
+              h.magic == MAGIC_PACKED && (type == INVALID || h.type == type) &&
+              packed.block_size > 0 &&
+              packed.num_blocks ==
+                  (h.size + packed.block_size - 1) / packed.block_size;
+    u64 *offsets = NULL;
+    u64 bytes = (u64(packed.num_blocks) + 1) * sizeof(u64);
+    if (ok) {
+        offsets = (u64 *)malloc(bytes);
+        ok = offsets && pread(fd, offsets, bytes, sizeof(h) + sizeof(packed)) ==
+                            s64(bytes);
+    }
+
+    // The table goes into anonymous memory, aligned for transparent huge
+    // pages, with the header in front of it like in a mapped file.
+    u64 huge = MiB(2);
+    u64 length = huge + RoundUp(h.size, huge);
+    u8 *mem = ok ? (u8 *)mmap(NULL, length + huge, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                 : (u8 *)MAP_FAILED;
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "'%s' is not a packed database\n", path);
+        free(offsets);
+        close(fd);
+        return false;
+    }
+    data = (u8 *)RoundUp(u64(mem) + huge, huge);
+    madvise(data, RoundUp(h.size, huge), MADV_HUGEPAGE);
+    map = data - sizeof(Header);
+    hdr = (Header *)map;
+    *hdr = h;
+    hdr->magic = MAGIC;
+
+    u32 table[1 << PACK_MAX_BITS];
+    MultiTable(packed.lengths, table);
+    UnpackJob job = {fd, &packed, offsets, sizeof(h) + sizeof(packed) + bytes,
+                     table, data, h.size, 0, true};
+    pthread_t tids[64];
+    s32 started = 0;
+    threads = Min(Max(threads, 1), 64);
+    for (s32 t = 1; t < threads; t++) {
+        started +=
+            pthread_create(&tids[started], NULL, UnpackWorker, &job) == 0;
+    }
+    UnpackWorker(&job);
+    for (s32 t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(offsets);
+    close(fd);
+    if (!job.ok) {
+        fprintf(stderr, "'%s' is truncated\n", path);
+    }
+    return job.ok;
+}
+
+// Writes `db` packed to `path`.
+internal bool Pack(const Database &db, const char *path) {
+    u64 freq[256] = {};
+    for (u64 i = 0; i < db.hdr->size; i++) {
+        freq[db.data[i]]++;
+    }
+    PackedHeader packed = {};
+    packed.block_size = PACK_BLOCK;
+    packed.num_blocks = (db.hdr->size + PACK_BLOCK - 1) / PACK_BLOCK;
+    HuffmanLengths(freq, packed.lengths);
+    u16 codes[256];
+    HuffmanCodes(packed.lengths, codes);
+
+    // Every code is at most PACK_MAX_BITS long, so the blocks fit in a buffer
+    // of 3/2 the table size.
+    u64 capacity = db.hdr->size * PACK_MAX_BITS / 8 + PACK_PADDING;
+    u8 *out = (u8 *)malloc(capacity);
+    u64 *offsets = (u64 *)malloc((packed.num_blocks + 1) * sizeof(u64));
+    if (out == NULL || offsets == NULL) {
+        printf("could not allocate memory\n");
+        free(out);
+        free(offsets);
+        return false;
+    }
+    u64 n = 0;
+    for (u32 b = 0; b < packed.num_blocks; b++) {
+        offsets[b] = n;
+        u64 begin = u64(b) * PACK_BLOCK;
+        u64 end = Min(u64(begin + PACK_BLOCK), db.hdr->size);
+        u64 bits = 0;
+        s32 count = 0;
+        for (u64 i = begin; i < end; i++) {
+            bits |= u64(codes[db.data[i]]) << count;
+            count += packed.lengths[db.data[i]];
+            while (count >= 8) {
+                out[n++] = u8(bits);
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+        if (count > 0) {
+            out[n++] = u8(bits);
+        }
+    }
+    offsets[packed.num_blocks] = n;
+
+    Database::Header h = *db.hdr;
+    h.magic = MAGIC_PACKED;
+    FILE *file = fopen(path, "wb");
+    bool ok = file != NULL && fwrite(&h, sizeof(h), 1, file) == 1 &&
+              fwrite(&packed, sizeof(packed), 1, file) == 1 &&
+              fwrite(offsets, sizeof(u64), packed.num_blocks + 1, file) ==
+                  packed.num_blocks + 1 &&
+              fwrite(out, 1, n, file) == n;
+    if (file == NULL || fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        perror("write");
+    }
+    free(out);
+    free(offsets);
+    return ok;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+/// Hardware counters of the calling thread, to see how the database lookups
+/// use the caches and the TLB. Counters that the machine or the kernel does
+/// not offer, as in most virtual machines, stay closed and read as 0.
+
+struct PerfCounters {
+    enum Counter { LLC_MISSES, DTLB_MISSES, NUM_COUNTERS };
+
+    s32 fd[NUM_COUNTERS];
+    u64 last[NUM_COUNTERS]{};
+
+    // With `enabled` false, no counter is opened and Lap() reads nothing.
+    explicit PerfCounters(bool enabled = true) {
+        const u32 types[] = {PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+        const u64 configs[] = {
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                PERF_COUNT_HW_CACHE_RESULT_MISS << 16};
+        for (s32 i = 0; i < NUM_COUNTERS; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd[i] = enabled ? syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)
+                            : -1;
+        }
+    }
+
+    ~PerfCounters() {
+        for (s32 i = 0; i < NUM_COUNTERS; i++) {
+            if (fd[i] != -1) {
+                close(fd[i]);
+            }
+        }
+    }
+
+    bool Available() const {
+        return fd[LLC_MISSES] != -1 || fd[DTLB_MISSES] != -1;
+    }
+
+    // The counts since the previous call.
+    void Lap(u64 out[NUM_COUNTERS]) {
+        for (s32 i = 0; i < NUM_COUNTERS; i++) {
+            u64 now = 0;
+            if (fd[i] != -1 && read(fd[i], &now, sizeof(now)) != sizeof(now)) {
+                now = last[i];
+            }
+            out[i] = now - last[i];
+            last[i] = now;
+        }
+    }
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+EffortPredictor::EffortPredictor(const DatabaseSet &dbs, s32 threads) {
+    // count[m] are the nodes at the current depth whose last move index is m,
+    // the valid moves prune the same redundant sequences as the search does
+    f64 count[19] = {1};
+    for (s32 d = 0; d <= MAX_DEPTH; d++) {
+        f64 next[19] = {};
+        tree_[d] = 0;
+        for (s32 m = 0; m < 19; m++) {
+            tree_[d] += count[m];
+            for (u32 valid = kValidMoves[m]; valid; valid &= valid - 1) {
+                next[__builtin_ctz(valid) + 1] += count[m];
+            }
+        }
+        memcpy(count, next, sizeof(count));
+    }
+
+    const Database *db[] = {&dbs.corner, &dbs.edge1, &dbs.edge2, &dbs.perm};
+    for (s32 x = 0; x < 16; x++) {
+        cdf_[x] = 1;
+    }
+    for (const Database *d : db) {
+        u64 counts[16];
+        d->Histogram(counts, threads);
+        u64 sum = 0;
+        for (s32 x = 0; x < 16; x++) {
+            sum += counts[x];
+            cdf_[x] *= sum / f64(d->hdr->num_entries);
+        }
+    }
+}
+
+f64 EffortPredictor::Nodes(u8 bound) const {
+    // the children of every expanded node are generated
+    f64 nodes = 0;
+    for (s32 i = 0; i <= bound && i < MAX_DEPTH; i++) {
+        nodes += tree_[i + 1] * cdf_[Min(bound - i, 15)];
+    }
+    return nodes;
+}
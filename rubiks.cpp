@@ -0,0 +1,137 @@
+#include "rubiks.h"
+
+// clang-format off
+#include "deque.cpp"
+#include "bfs.cpp"
+#include "search.cpp"
+#include "batch.cpp"
+#include "cache.cpp"
+#include "predictor.cpp"
+#include "descent.cpp"
+#include "pack.cpp"
+#include "workunit.cpp"
+// clang-format on
+
+static const char *kDatabaseNames[] = {"corner", "edge1", "edge2", "perm"};
+static const Database::Type kDatabaseTypes[] = {
+    Database::CORNER, Database::EDGE1, Database::EDGE2, Database::PERMUTATION};
+
+bool DatabaseSet::Load(const char *dir) {
+    Database *db[] = {&corner, &edge1, &edge2, &perm};
+    for (s32 i = 0; i < 4; i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.db", dir, kDatabaseNames[i]);
+        if (access(path, R_OK) == 0) {
+            if (!db[i]->MemoryMapReadOnly(path, kDatabaseTypes[i])) {
+                return false;
+            }
+            continue;
+        }
+        // a packed database is decoded in full, by all cores
+        snprintf(path, sizeof(path), "%s/%s.dbz", dir, kDatabaseNames[i]);
+        if (access(path, R_OK) != 0 ||
+            !db[i]->LoadPacked(path, kDatabaseTypes[i],
+                               sysconf(_SC_NPROCESSORS_ONLN))) {
+            return false;
+        }
+    }
+    GenerateOrientationTables();
+    return true;
+}
+
+// Breadth-first search over one representative cube per orientation.
+void DatabaseSet::GenerateOrientationTables() {
+    Cube queue[2187];
+    memset(corner_ori, 0xff, sizeof(corner_ori));
+    memset(edge_ori, 0xff, sizeof(edge_ori));
+    for (s32 pass = 0; pass < 2; pass++) {
+        u8 *table = pass == 0 ? corner_ori : edge_ori;
+        auto index = [pass](const Cube &c) {
+            return pass == 0 ? CornerOrientationIndex(c) : EdgeOrientationIndex(c);
+        };
+        s32 head = 0, tail = 0;
+        Init(queue[tail++]);
+        table[0] = 0;
+        while (head < tail) {
+            Cube cube = queue[head++];
+            u8 depth = table[index(cube)];
+            for (s32 move = 0; move < 18; move++) {
+                Cube next = cube;
+                ApplyMove(next, move);
+                u32 i = index(next);
+                if (table[i] == 0xff) {
+                    table[i] = depth + 1;
+                    queue[tail++] = next;
+                }
+            }
+        }
+    }
+}
+
+internal void *ReadAheadWorker(void *arg) {
+    ((Database *)arg)->ReadAhead();
+    return NULL;
+}
+
+bool DatabaseSet::LoadAsync(const char *dir) {
+    if (!Load(dir)) {
+        return false;
+    }
+
+    // The search needs at least one database, the corner db is the smallest
+    // and has the highest mean.
+    if (!corner.Resident()) {
+        corner.ReadAhead();
+    }
+
+    Database *db[] = {&edge1, &edge2, &perm};
+    for (Database *d : db) {
+        if (d->Resident()) {
+            continue;
+        }
+        d->ready = false;
+        if (pthread_create(&loaders[num_loaders], NULL, ReadAheadWorker, d) == 0) {
+            num_loaders++;
+        } else {
+            d->ReadAhead();
+        }
+    }
+    return true;
+}
+
+void DatabaseSet::WaitUntilLoaded() {
+    for (s32 i = 0; i < num_loaders; i++) {
+        pthread_join(loaders[i], NULL);
+    }
+    num_loaders = 0;
+}
+
+bool DatabaseSet::Generate(const char *dir) {
+    u64 csize = Factorial(8) * Power(3, 7);
+    u64 esize = (Factorial(12) / Factorial(12 - PICKED)) * Power(2, PICKED);
+    u64 psize = Factorial(12);
+    printf("8! * 3^7 corner db size = %lluMiB\n", csize / MiB(1) / 2);
+    printf("2x 12P%d edge db size = %lluMiB\n", PICKED, esize / MiB(1) / 2);
+    printf("12! permutation db size = %lluMiB\n", psize / MiB(1) / 2);
+
+    Database *db[] = {&corner, &edge1, &edge2, &perm};
+    u64 sz[] = {csize, esize, esize, psize};
+    for (s32 i = 0; i < 4; i++) {
+        printf("Generating '%s'\n", kDatabaseNames[i]);
+        if (!db[i]->Alloc(sz[i], kDatabaseTypes[i])) {
+            return false;
+        }
+
+        if (!Bfs(*db[i], IndexerFor(kDatabaseTypes[i]),
+                 UnrankerFor(kDatabaseTypes[i]))) {
+            fprintf(stderr, "not enough memory\n");
+            return false;
+        }
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.db", dir, kDatabaseNames[i]);
+        printf("%s mean = %0.3f\n", kDatabaseNames[i], db[i]->Mean());
+        db[i]->Write(path);
+    }
+    return true;
+}
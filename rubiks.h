@@ -0,0 +1,258 @@
+#pragma once
+
+/// librubiks, an optimal Rubik's cube solver.
+///
+/// A DatabaseSet holds the pattern databases, it is loaded (or generated) once
+/// and shared read-only by any number of Solvers. Solver::Solve() keeps all
+/// per-solve state on its own stack, so solves can run concurrently from
+/// different threads, also on the same Solver.
+///
+///   DatabaseSet dbs;
+///   if (!dbs.Load("data")) ...
+///   Solver solver(dbs);
+///   Solution solution = solver.Solve(cube, options);
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#define PICKED 6
+
+// clang-format off
+#include "utils.cpp"
+#include "perf.cpp"
+#include "database.cpp"
+#include "indexer.cpp"
+#include "model.cpp"
+// clang-format on
+
+#define MAX_DEPTH 32
+#define MAX_LANES 64
+
+class EffortPredictor;
+
+struct SolveOptions {
+    // Give up on proving optimality after this many seconds or generated
+    // nodes, 0 means no limit.
+    f64 time_limit{0};
+    u64 node_limit{0};
+    // Weight of the bounded-suboptimal search that finds the first solution
+    // when a limit is set, its solutions are at most weight times optimal.
+    // Every following search halves the excess weight to find a shorter one.
+    f64 weight{5.0};
+    // Order the lookups of every node by their measured cost and prune rate
+    // instead of the fixed order corner, edge1, edge2, perm.
+    bool adaptive{false};
+    // Also look up the rotated cube of every expanded node, see
+    // SYMMETRIC_LOOKUP.
+    bool symmetric{false};
+    // Also look up the inverse cube of every expanded node, and propagate h
+    // between a node and its children in both directions (BPMX).
+    bool bpmx{false};
+    // If non-zero, Dfs() skips states it already reached in the iteration
+    // at the same or a smaller depth, with a table of this many bytes.
+    u64 table_memory{0};
+    // If non-zero, every iteration continues from the nodes the previous one
+    // cut off instead of from the root, as long as they fit in this many
+    // bytes. Then the search goes back to plain IDA*.
+    u64 fringe_memory{0};
+    // If non-zero and no limit is set, search with A* instead, as long as its
+    // nodes fit in this many bytes. Then the search starts over with IDA*.
+    u64 astar_memory{0};
+    // If non-zero, first try a bidirectional search without the databases,
+    // for solutions of up to 12 moves whose states fit in this many bytes.
+    u64 bidir_memory{0};
+    // Print the progress of every iteration to stdout.
+    bool verbose{false};
+    // With verbose, print the predicted size of every iteration before it
+    // starts, sampled with this many probes if non-zero.
+    const EffortPredictor *predictor{nullptr};
+    u32 probes{0};
+};
+
+struct Solution {
+    u8 moves[MAX_DEPTH];
+    s32 length{-1};
+    bool optimal{false};
+    u64 nodes{0};
+    // Taken from the SolutionCache, no search was done.
+    bool cached{false};
+};
+
+struct DatabaseSet {
+    Database corner;
+    Database edge1;
+    Database edge2;
+    Database perm;
+    // Distances of the corner and edge orientations alone, one byte per entry.
+    // They are weak, but stay in L1 and may prune a child before the large
+    // databases are touched.
+    u8 corner_ori[2187];
+    u8 edge_ori[2048];
+
+    // Maps the databases in `dir`, false if any of them is missing or invalid.
+    // A name.dbz in place of name.db is decoded into memory instead.
+    bool Load(const char *dir);
+    // Like Load(), but only waits for the corner database to be read from disk.
+    // The others are read in by background threads and the search starts using
+    // each one as soon as it is complete. Databases that are already in the
+    // page cache, or were packed, are used right away.
+    bool LoadAsync(const char *dir);
+    // Blocks until the background threads of LoadAsync() are done.
+    void WaitUntilLoaded();
+    // Generates the orientation tables, done by Load().
+    void GenerateOrientationTables();
+    // Generates all databases into `dir`, false if we ran out of memory.
+    bool Generate(const char *dir);
+
+    const Database &Get(s32 i) const {
+        const Database *db[] = {&corner, &edge1, &edge2, &perm};
+        return *db[i];
+    }
+
+    pthread_t loaders[4];
+    s32 num_loaders{0};
+};
+
+/// Predicts the number of nodes an IDA* iteration generates with the formula of
+/// Korf, Reid and Edelkamp: the brute force tree has N(i) nodes at depth i,
+/// and a node at depth i is expanded when its heuristic is at most bound - i.
+/// The chance of that is taken from the distribution of values in the
+/// databases, assuming they are independent.
+class EffortPredictor {
+   public:
+    // Scans the databases, which must be loaded completely.
+    explicit EffortPredictor(const DatabaseSet &dbs, s32 threads = 1);
+
+    // Children generated by the iteration with this bound, the same count as
+    // Solution::nodes.
+    f64 Nodes(u8 bound) const;
+
+   private:
+    // nodes per depth of the tree without pruning by the heuristic
+    f64 tree_[MAX_DEPTH + 1];
+    // P(h <= x) of the maximum over all databases
+    f64 cdf_[16];
+};
+
+struct IterationEstimate {
+    u8 bound;
+    // by the EffortPredictor
+    f64 korf;
+    // by Knuth's random probes of the actual search tree, 0 without probes
+    f64 sampled;
+    // sampled (or korf) nodes at the speed the probes were generated
+    f64 seconds;
+};
+
+struct CacheStats {
+    u64 hits{0};
+    u64 misses{0};
+    u64 inserts{0};
+    u64 evictions{0};
+    // Seconds spent in Lookup(), including the canonicalization.
+    f64 lookup_time{0};
+};
+
+/// Bounded cache of optimal solutions. A cube is stored under the smallest of
+/// its 48 conjugates by the symmetries of the cube, so rotated and mirrored
+/// scrambles share an entry, and solutions are mapped back to the orientation
+/// of the cube that is looked up. Safe to share between threads.
+class SolutionCache {
+   public:
+    // Holds about `capacity` solutions, rounded up to a power of two.
+    explicit SolutionCache(u64 capacity);
+    ~SolutionCache();
+
+    bool Lookup(const Cube &cube, Solution &solution);
+    // Only optimal solutions are stored.
+    void Insert(const Cube &cube, const Solution &solution);
+    bool Load(const char *path);
+    bool Save(const char *path) const;
+    CacheStats Stats() const;
+
+   private:
+    struct Entry;
+    Entry *Find(const Cube &key);
+
+    Entry *entries_;
+    u64 mask_;
+    u32 clock_{0};
+    CacheStats stats_;
+    mutable pthread_mutex_t lock_;
+};
+
+/// Rounds of a distributed solve, see Solver::Split(). A worker either found
+/// a solution or reports the smallest bound above its own, NOT_FOUND (255)
+/// if none of its nodes had any children left.
+struct WorkResult {
+    bool found{false};
+    u8 next{255};
+    u64 nodes{0};
+    Solution solution;
+};
+
+// False while the unit has no result.
+bool ReadWorkResult(const char *unit, WorkResult &result);
+bool SetWorkUnitBound(const char *unit, u8 bound);
+// Creates an empty transposition table at `path` for the workers to share,
+// see Solver::Work().
+bool CreateTranspositionTable(const char *path, u64 bytes);
+
+class Solver {
+   public:
+    // Solutions are looked up in and added to `cache`, if given.
+    explicit Solver(const DatabaseSet &dbs, SolutionCache *cache = nullptr)
+        : dbs_(dbs), cache_(cache) {}
+
+    Solution Solve(Cube root, const SolveOptions &options = SolveOptions()) const;
+
+    // Solves the `n` cubes optimally, interleaving `width` searches on the
+    // calling thread to overlap their database lookups. The options of
+    // Solve() do not apply, there are no limits.
+    void SolveBatch(const Cube *roots, Solution *solutions, s32 n, s32 width) const;
+
+    // Solves only the part of `cube` that the database of type `goal` covers,
+    // e.g. the corners, by walking down the database. The solution is optimal
+    // for that sub-goal and takes no search. Fails while the database is still
+    // loading.
+    Solution SolveSubgoal(Cube cube, Database::Type goal) const;
+
+    // Solves the `n` sub-goals one after another, each stage with the fewest
+    // moves from where the previous ones left the cube that keep their
+    // sub-goals solved. Later stages search where no walk down their
+    // database does, which may take seconds. The moves of stage i end at
+    // ends[i], if given.
+    Solution SolveStages(Cube cube, const Database::Type *goals, s32 n,
+                         s32 *ends = nullptr) const;
+
+    // Writes the states `depth` moves from `root` to `units` work unit files
+    // in `dir`, see workunit.cpp, and sets the bound of the first round.
+    // Returns the number of units, 0 if the cube is solved within `depth`
+    // moves, which is then the solution, and -1 on errors.
+    s32 Split(Cube root, s32 depth, s32 units, const char *dir,
+              Solution &solution, u8 &bound) const;
+
+    // Searches the work unit with its bound and writes the result next to it.
+    // With `table_memory`, the workers share a transposition table in the
+    // file "table" next to the unit, see ttable.cpp.
+    bool Work(const char *unit, u64 table_memory = 0) const;
+
+    // Estimates the `n` IDA* iterations that follow the one with bound h(root),
+    // including that one, using `probes` random probes per iteration.
+    void Estimate(Cube root, const EffortPredictor &predictor, u32 probes,
+                  IterationEstimate *out, s32 n) const;
+
+   private:
+    const DatabaseSet &dbs_;
+    SolutionCache *cache_;
+};
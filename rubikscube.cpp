@@ -1,45 +1,321 @@
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-
-#include <cassert>
-#include <cerrno>
 #include <clocale>
-#include <csignal>
-#include <cstdio>
-#include <cstdlib>
-#include <cstring>
-#include <ctime>
-
-#define PICKED 6
-
-// clang-format off
-#include "utils.cpp"
-#include "database.cpp"
-#include "indexer.cpp"
-#include "model.cpp"
-#include "deque.cpp"
-#include "bfs.cpp"
-#include "search.cpp"
-// clang-format on
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "rubiks.h"
+
+internal void PrintSolution(Cube root, const Solution &solution) {
+    printf("\n");
+    for (s32 i = 0; i < solution.length; i++) {
+        printf("%s ", kNames[solution.moves[i]]);
+        kMoves[solution.moves[i]](root);
+    }
+    printf("(%d%s%s)\n", solution.length,
+           solution.optimal ? "" : ", optimality not proven",
+           solution.cached ? ", cached" : "");
+    PrettyPrint(root);
+}
+
+// Whether data/ holds the database, plain or packed.
+internal bool HaveDatabase(const char *name) {
+    char path[64];
+    snprintf(path, sizeof(path), "data/%s.db", name);
+    if (access(path, F_OK) == 0) {
+        return true;
+    }
+    snprintf(path, sizeof(path), "data/%s.dbz", name);
+    return access(path, F_OK) == 0;
+}
+
+// Parses a comma separated list of database names into sub-goals.
+internal s32 ParseStages(char *list, Database::Type *goals, s32 max) {
+    static const char *kStageNames[] = {"corner", "edge1", "edge2", "perm"};
+    s32 n = 0;
+    for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        s32 i = 0;
+        while (i < 4 && strcmp(name, kStageNames[i]) != 0) {
+            i++;
+        }
+        if (i == 4 || n == max) {
+            return -1;
+        }
+        goals[n++] = Database::Type(Database::CORNER + i);
+    }
+    return n;
+}
+
+// Solves `count` random scrambles one after another and then interleaved,
+// and compares the throughput. Both must find the lengths of the
+// bidirectional search, which needs no databases and is exact for scrambles
+// of up to 12 moves.
+internal s32 Batch(const DatabaseSet &dbs, s32 moves, s32 count, s32 width) {
+    Cube *roots = new Cube[count];
+    Solution *sequential = new Solution[count];
+    Solution *interleaved = new Solution[count];
+    s32 *optimal = new s32[count];
+    for (s32 i = 0; i < count; i++) {
+        Init(roots[i]);
+        for (s32 j = 0; j < moves; j++) {
+            ApplyMove(roots[i], rand() % 18);
+        }
+    }
+
+    Solver solver(dbs);
+    u64 nodes = 0;
+    f64 start = Now();
+    for (s32 i = 0; i < count; i++) {
+        sequential[i] = solver.Solve(roots[i]);
+        nodes += sequential[i].nodes;
+    }
+    f64 t1 = Now() - start;
+
+    start = Now();
+    solver.SolveBatch(roots, interleaved, count, width);
+    f64 t2 = Now() - start;
+
+    SolveOptions reference;
+    reference.bidir_memory = MiB(1024);
+    for (s32 i = 0; i < count; i++) {
+        optimal[i] = solver.Solve(roots[i], reference).length;
+    }
+
+    s32 mismatches = 0, wrong = 0;
+    for (s32 i = 0; i < count; i++) {
+        mismatches += sequential[i].length != interleaved[i].length ||
+                      sequential[i].nodes != interleaved[i].nodes;
+        wrong += sequential[i].length != optimal[i] ||
+                 interleaved[i].length != optimal[i];
+    }
+    printf("%d scrambles of %d moves, %'lu nodes\n", count, moves, nodes);
+    printf("sequential  %8.3fs %8.2f solves/s %'12lu N/s\n", t1, count / t1,
+           u64(nodes / t1));
+    printf("interleaved %8.3fs %8.2f solves/s %'12lu N/s (%d lanes)\n", t2,
+           count / t2, u64(nodes / t2), width);
+    if (mismatches) {
+        printf("%d solutions differ\n", mismatches);
+    }
+    if (wrong) {
+        printf("%d solutions are not optimal\n", wrong);
+    }
+
+    delete[] roots;
+    delete[] sequential;
+    delete[] interleaved;
+    delete[] optimal;
+    return mismatches || wrong ? 1 : 0;
+}
+
+// Stops the workers of `pids` that are still running and waits for them.
+internal void StopWorkers(const pid_t *pids, s32 launched) {
+    for (s32 i = 0; i < launched; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    for (s32 i = 0; i < launched; i++) {
+        if (pids[i] > 0) {
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+}
+
+// Solves `root` in rounds of work units in `dir`, every unit by a worker
+// process that runs this program with -W, at most `jobs` at a time. Workers
+// only share the files, so they could as well run on other machines. With
+// `table_mib`, they also share a transposition table in `dir`.
+internal s32 Distribute(const DatabaseSet &dbs, Cube root, const char *dir,
+                        s32 depth, s32 jobs, u64 table_mib) {
+    Solver solver(dbs);
+    Solution solution;
+    u8 bound;
+    jobs = Max(jobs, 1);
+    s32 units = solver.Split(root, depth, 4 * jobs, dir, solution, bound);
+    if (units < 0) {
+        return 1;
+    }
+    char table_arg[32];
+    snprintf(table_arg, sizeof(table_arg), "%lu", table_mib);
+    // Split() creates `dir` only if it leaves units to search.
+    if (units > 0 && table_mib > 0) {
+        // the entries of an earlier solve would skip states of this one
+        char path[4096 + 8];
+        snprintf(path, sizeof(path), "%s/table", dir);
+        if (!CreateTranspositionTable(path, MiB(table_mib))) {
+            return 1;
+        }
+    }
+    u64 total = 0;
+    f64 start = Now();
+    while (units > 0) {
+        f64 begin = Now();
+        char path[4096 + 16];
+        for (s32 k = 0; k < units; k++) {
+            snprintf(path, sizeof(path), "%s/unit.%d", dir, k);
+            if (!SetWorkUnitBound(path, bound)) {
+                return 1;
+            }
+            snprintf(path, sizeof(path), "%s/unit.%d.result", dir, k);
+            unlink(path);
+        }
+
+        // Once a worker found a solution, the others are stopped, a solution
+        // found in this round is as short as any other.
+        pid_t *pids = new pid_t[units];
+        s32 running = 0, launched = 0, reported = 0;
+        bool found = false;
+        WorkResult merged;
+        u64 nodes = 0;
+        while (running > 0 || (launched < units && !found)) {
+            if (launched < units && running < jobs && !found) {
+                snprintf(path, sizeof(path), "%s/unit.%d", dir, launched);
+                fflush(stdout);
+                pid_t pid = fork();
+                if (pid == 0) {
+                    // quiet, the coordinator prints the progress
+                    if (freopen("/dev/null", "w", stdout)) {
+                        execl("/proc/self/exe", "rubiks", "-T", table_arg,
+                              "-W", path, (char *)NULL);
+                    }
+                    _exit(127);
+                }
+                if (pid < 0) {
+                    perror("fork");
+                    StopWorkers(pids, launched);
+                    delete[] pids;
+                    return 1;
+                }
+                pids[launched++] = pid;
+                running++;
+                continue;
+            }
+            s32 status;
+            pid_t pid = wait(&status);
+            if (pid <= 0) {
+                break;
+            }
+            running--;
+            s32 k = 0;
+            while (k < launched && pids[k] != pid) {
+                k++;
+            }
+            pids[k] = 0;
+            WorkResult result;
+            snprintf(path, sizeof(path), "%s/unit.%d", dir, k);
+            if (found) {
+                continue;
+            }
+            if (!ReadWorkResult(path, result)) {
+                fprintf(stderr, "unit %d has no result\n", k);
+                StopWorkers(pids, launched);
+                delete[] pids;
+                return 1;
+            }
+            reported++;
+            nodes += result.nodes;
+            merged.next = Min(result.next, merged.next);
+            if (result.found) {
+                found = true;
+                merged = result;
+                for (s32 i = 0; i < launched; i++) {
+                    if (pids[i] > 0) {
+                        kill(pids[i], SIGTERM);
+                    }
+                }
+            }
+        }
+        delete[] pids;
+        if (!found && reported < units) {
+            fprintf(stderr, "%d of %d units have no result\n", units - reported,
+                    units);
+            return 1;
+        }
+        total += nodes;
+        printf("D%5.3f B:%02u N:%'lu units:%d\n", Now() - begin, bound, nodes,
+               units);
+        if (merged.found) {
+            solution = merged.solution;
+            break;
+        }
+        if (merged.next == 255) {
+            printf("no solution found\n");
+            return 1;
+        }
+        bound = merged.next;
+    }
+    printf("%'lu nodes in %0.3fs\n", total, Now() - start);
+    PrintSolution(root, solution);
+    return 0;
+}
 
 s32 main(s32 argc, char *argv[]) {
     setlocale(LC_NUMERIC, "");
 
+    SolveOptions options;
+    options.verbose = true;
+    bool fast_start = false;
+    const char *cache_path = NULL;
+    bool predict = false;
+    s32 batch = 0, lanes = 8;
+    const char *work_dir = NULL, *work_unit = NULL;
+    s32 split_depth = 3, jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    Database::Type stages[8];
+    s32 num_stages = 0;
+    s32 opt;
+    const char *flags = "asxfF:A:B:T:c:p:b:l:g:t:n:w:u:d:j:W:";
+    while ((opt = getopt(argc, argv, flags)) != -1) {
+        switch (opt) {
+            case 'a': options.adaptive = true; break;
+            case 's': options.symmetric = true; break;
+            case 'x': options.bpmx = true; break;
+            case 'f': fast_start = true; break;
+            case 'F':
+                options.fringe_memory = MiB(strtoull(optarg, NULL, 10));
+                break;
+            case 'A':
+                options.astar_memory = MiB(strtoull(optarg, NULL, 10));
+                break;
+            case 'B':
+                options.bidir_memory = MiB(strtoull(optarg, NULL, 10));
+                break;
+            case 'T':
+                options.table_memory = MiB(strtoull(optarg, NULL, 10));
+                break;
+            case 'c': cache_path = optarg; break;
+            case 'p':
+                predict = true;
+                options.probes = atoi(optarg);
+                break;
+            case 'b': batch = atoi(optarg); break;
+            case 'l': lanes = atoi(optarg); break;
+            case 'g':
+                num_stages = ParseStages(optarg, stages, 8);
+                if (num_stages < 0) {
+                    fprintf(stderr, "stages are corner, edge1, edge2 or perm\n");
+                    return 1;
+                }
+                break;
+            case 't': options.time_limit = atof(optarg); break;
+            case 'n': options.node_limit = strtoull(optarg, NULL, 10); break;
+            case 'w': options.weight = atof(optarg); break;
+            case 'u': work_dir = optarg; break;
+            case 'd': split_depth = atoi(optarg); break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'W': work_unit = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-a] [-s] [-x] [-f] [-F MiB] [-A MiB] [-B MiB] [-T MiB] [-c cache] [-p probes] [-b count [-l lanes]] "
+                        "[-g stage,...] [-t seconds] [-n nodes] [-w weight] "
+                        "[-u dir [-d depth] [-j jobs]] [-W unit] [moves]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
     s32 n = 10;
-    if (argc > 1) {
-        n = atoi(argv[1]);
+    if (optind < argc) {
+        n = atoi(argv[optind]);
     }
     srand(2);
 
-    auto cornerpath = "data/corner.db";
-    auto edge1path = "data/edge1.db";
-    auto edge2path = "data/edge2.db";
-    auto permpath = "data/perm.db";
-    u64 csize = Factorial(8) * Power(3, 7);
-    u64 esize = (Factorial(12) / Factorial(12 - PICKED)) * Power(2, PICKED);
-    u64 psize = Factorial(12);
-
     if (access("data", R_OK | W_OK | X_OK) != 0) {
         if (mkdir("data", 0775) != 0) {
             perror("mkdir 'data'");
@@ -49,24 +325,23 @@ s32 main(s32 argc, char *argv[]) {
         }
     }
 
-    Database *db[] = {&cornerdb, &edge1db, &edge2db, &permdb};
-    const char *names[] = {"corner", "edge1", "edge2", "permutation"};
-    const char *paths[] = {cornerpath, edge1path, edge2path, permpath};
-    const Database::Type types[] = { Database::CORNER, Database::EDGE1, Database::EDGE2, Database::PERMUTATION };
+    DatabaseSet dbs;
+    if (HaveDatabase("corner") && HaveDatabase("edge1") &&
+        HaveDatabase("edge2") && HaveDatabase("perm")) {
 
-    if (access(cornerpath, F_OK) == 0 && access(edge1path, F_OK) == 0 &&
-        access(edge2path, F_OK) == 0 && access(permpath, F_OK) == 0) {
-
-        for (s32 i = 0; i < 4; i++) {
-            printf("Loading '%s'\n", names[i]);
-            if (!db[i]->MemoryMapReadOnly(paths[i], types[i])) {
-                printf("invalid file\n");
-                return 1;
-            }
+        printf("Loading databases\n");
+        if (!(fast_start ? dbs.LoadAsync("data") : dbs.Load("data"))) {
+            printf("invalid file\n");
+            return 1;
+        }
+        if (batch > 0) {
+            return Batch(dbs, n, batch, lanes);
+        }
+        if (work_unit) {
+            return Solver(dbs).Work(work_unit, options.table_memory) ? 0 : 1;
         }
 
         Cube root;
-        Init(goal);
         Init(root);
         // scramble the cube
         for (s32 i = 0; i < n; i++) {
@@ -76,34 +351,54 @@ s32 main(s32 argc, char *argv[]) {
         }
         printf("\n");
         PrettyPrint(root);
-        // solve the cube
-        IDAStar(root);
-    } else {
-        printf("8! * 3^7 corner db size = %lluMiB\n", csize / MiB(1) / 2);
-        printf("2x 12P%d edge db size = %lluMiB\n", PICKED, esize / MiB(1) / 2);
-        printf("12! permutation db size = %lluMiB\n", psize / MiB(1) / 2);
-
-        u64 sz[] = {csize, esize, esize, psize};
-        Indexer indexer[] = {
-            [](Cube &c) { return CornerIndex(c); },
-            [](Cube &c) { return EdgeIndex<PICKED>(c, 0); },
-            [](Cube &c) { return EdgeIndex<PICKED>(c, 12 - PICKED); },
-            [](Cube &c) { return PermutationIndex(c); }};
-
-        for (s32 i = 0; i < 4; i++) {
-            printf("Generating '%s'\n", names[i]);
-            if (!db[i]->Alloc(sz[i], types[i])) {
+        if (work_dir) {
+            return Distribute(dbs, root, work_dir, split_depth, jobs,
+                              options.table_memory / MiB(1));
+        }
+        if (num_stages > 0) {
+            Solver solver(dbs);
+            s32 ends[8];
+            f64 start = Now();
+            Solution solution = solver.SolveStages(root, stages, num_stages, ends);
+            f64 elapsed = Now() - start;
+            if (solution.length < 0) {
+                printf("no solution found\n");
                 return 1;
             }
-
-            if (!Bfs(*db[i], indexer[i])) {
-                fprintf(stderr, "not enough memory\n");
-                return 1;
+            for (s32 i = 0; i < num_stages; i++) {
+                printf("stage %d: %d moves\n", i + 1, ends[i] - (i ? ends[i - 1] : 0));
             }
-
-            printf("%s mean = %0.3f\n", names[i], db[i]->Mean());
-            db[i]->Write(paths[i]);
+            printf("%'lu lookups in %0.1fus\n", solution.nodes, elapsed * 1e6);
+            PrintSolution(root, solution);
+            return 0;
+        }
+        // solve the cube
+        SolutionCache cache(KiB(64));
+        if (cache_path) {
+            cache.Load(cache_path);
+        }
+        Solver solver(dbs, cache_path ? &cache : NULL);
+        EffortPredictor *predictor = NULL;
+        if (predict) {
+            predictor = new EffortPredictor(dbs, sysconf(_SC_NPROCESSORS_ONLN));
+            options.predictor = predictor;
+        }
+        Solution solution = solver.Solve(root, options);
+        if (solution.length < 0) {
+            printf("no solution found\n");
+            return 1;
+        }
+        PrintSolution(root, solution);
+        if (cache_path) {
+            CacheStats stats = cache.Stats();
+            printf("cache: %lu hits, %lu misses, %0.2fus per lookup\n", stats.hits,
+                   stats.misses,
+                   stats.lookup_time * 1e6 / Max(stats.hits + stats.misses, u64(1)));
+            cache.Save(cache_path);
         }
+        delete predictor;
+    } else if (!dbs.Generate("data")) {
+        return 1;
     }
 
     return 0;
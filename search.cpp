@@ -1,124 +1,1191 @@
+#include "symmetry.cpp"
+#include "fringe.cpp"
+#include "astar.cpp"
+#include "bidir.cpp"
+#include "ttable.cpp"
+
 #define FOUND 0
+#define ABORTED 254
 #define NOT_FOUND 255
-internal Cube goal;
-internal u64 nodes = 0;
-
-internal u8 Heuristic(Cube cube, u8 g, u8 bound) {
-    // we stop early if we exceed the bound. The databases are sorted from high
-    // to low on their mean value
-    u64 index;
-    index = CornerIndex(cube);
-    u8 h = cornerdb.Get(index);
-    if (g + 1 + h > bound) {
-        return h;
+
+// Share of the limits that the bounded-suboptimal search may use before the
+// optimal search starts.
+#define ANYTIME_SHARE 0.25
+
+// The search gives up once it exceeds the budget. The clock is only read
+// every 64K nodes.
+struct Budget {
+    u64 nodes{0};
+    f64 deadline{0};
+    u64 spent{0};
+    u64 next_check{0};
+    bool exhausted{false};
+};
+
+// The lookups are the databases in DatabaseSet order followed by the two
+// orientation tables. Search::ready has a bit per lookup, set once it can be
+// used.
+#define NUM_DATABASES 4
+#define NUM_LOOKUPS 6
+#define CORNER_ORI 4
+#define EDGE_ORI 5
+
+// The adaptive lookup order is kept per slack, the remaining bound of the
+// children, up to this many. One in SAMPLE_INTERVAL expansions is sampled.
+#define MAX_SLACK 16
+#define SAMPLE_INTERVAL 64
+
+// Without SolveOptions::adaptive only the databases are looked up, sorted from
+// high to low on their mean value. The orientation tables are cheap, but they
+// rarely prune a child that the databases would not.
+static const u8 kFixedOrder[NUM_DATABASES] = {0, 1, 2, 3};
+static const u8 kInitialOrder[NUM_LOOKUPS] = {CORNER_ORI, EDGE_ORI, 0, 1, 2, 3};
+
+// With SolveOptions::symmetric, the rotation about the x axis that swaps the
+// U/D and F/B layers. It raised h most often of the 48 symmetries, on 3.5% of
+// random states 14 moves deep.
+#define SYMMETRIC_LOOKUP 10
+
+#define WEIGHTED_FOUND 0u
+#define WEIGHTED_ABORTED 0xfffffffeu
+#define WEIGHTED_NOT_FOUND 0xffffffffu
+
+// All valid children of a node. They are generated and scored once, the
+// recursion then continues from the stored states.
+struct Children {
+    Cube cube[18];
+    u8 h[18];
+    s32 n;
+};
+
+// DB indices of all children, computed in lanes. The permutation digits are
+// gathered as structure-of-arrays so PermutationIndexer::IndexBatch can rank
+// 8 children per AVX2 register. 24 = 18 children rounded up to 3 registers.
+struct ChildIndices {
+    u64 corner[24];
+    u64 edge1[24];
+    u64 edge2[24];
+    u64 perm[24];
+    u64 corner_ori[24];
+    u64 edge_ori[24];
+
+    // in lookup order
+    const u64 *Get(s32 d) const {
+        const u64 *index[] = {corner, edge1, edge2, perm, corner_ori, edge_ori};
+        return index[d];
+    }
+};
+
+// `local_corners` if the corner database has the LOCAL ordering.
+internal void ComputeChildIndices(const Children &c, bool local_corners,
+                                  ChildIndices &out) {
+    constexpr u32 W = 24;
+    alignas(32) u8 corner_perm[8 * W] = {};
+    alignas(32) u8 edge1_perm[PICKED * W] = {};
+    alignas(32) u8 edge2_perm[PICKED * W] = {};
+    alignas(32) u8 edge_perm[12 * W] = {};
+    u32 corner_ori[W], edge1_ori[W], edge2_ori[W], edge_ori[W];
+
+    for (s32 j = 0; j < c.n; j++) {
+        const Cube &x = c.cube[j];
+        u32 ori = 0, n = 1;
+        for (s32 i = 0; i < 8; i++) {
+            corner_perm[i * W + j] = x.GetCornerPos(Corner(i));
+            if (i < 7) {
+                ori += x.GetCornerOri(Corner(i)) * n;
+                n *= 3;
+            }
+        }
+        corner_ori[j] = ori;
+
+        u32 ori1 = 0, ori2 = 0, flips = 0;
+        for (u32 i = 0; i < 12; i++) {
+            u32 cubie = x.GetEdgePos(Edge(i));
+            u32 flip = x.GetEdgeOri(Edge(i));
+            flips |= flip << i;
+            edge_perm[i * W + j] = cubie;
+            if (cubie < PICKED) {
+                edge1_perm[cubie * W + j] = i;
+                ori1 = (ori1 << 1) + flip;
+            }
+            if (cubie >= 12 - PICKED) {
+                edge2_perm[(cubie - (12 - PICKED)) * W + j] = i;
+                ori2 = (ori2 << 1) + flip;
+            }
+        }
+        edge1_ori[j] = ori1;
+        edge2_ori[j] = ori2;
+        edge_ori[j] = flips & 0x7ff;
+    }
+
+    u32 lanes = RoundUp(u32(c.n), 8u);
+    kCornerIndexer.IndexBatch(corner_perm, W, lanes, out.corner);
+    kEdgeIndexer.IndexBatch(edge1_perm, W, lanes, out.edge1);
+    kEdgeIndexer.IndexBatch(edge2_perm, W, lanes, out.edge2);
+    kPermutationIndexer.IndexBatch(edge_perm, W, lanes, out.perm);
+
+    for (s32 j = 0; j < c.n; j++) {
+        out.corner[j] = out.corner[j] * 2187 + corner_ori[j];
+        out.edge1[j] = out.edge1[j] * (1ull << PICKED) + edge1_ori[j];
+        out.edge2[j] = out.edge2[j] * (1ull << PICKED) + edge2_ori[j];
+        out.corner_ori[j] = corner_ori[j];
+        out.edge_ori[j] = edge_ori[j];
     }
-    index = EdgeIndex<PICKED>(cube, 0);
-    h = Max(edge1db.Get(index), h);
-    if (g + 1 + h > bound) {
+    if (local_corners) {
+        for (s32 j = 0; j < c.n; j++) {
+            Cube x = c.cube[j];
+            out.corner[j] = CornerLocalIndex(x);
+        }
+    }
+}
+
+internal void MoveBestToFront(Children &c, s32 i) {
+    s32 best = i;
+    for (s32 j = i + 1; j < c.n; j++) {
+        if (c.h[j] < c.h[best]) {
+            best = j;
+        }
+    }
+
+    Swap(c.cube[i], c.cube[best]);
+    Swap(c.h[i], c.h[best]);
+}
+
+// The state of a single solve. Solver::Solve() creates one on its stack, so
+// solves do not share anything but the read-only databases.
+struct Search {
+    const DatabaseSet &dbs;
+    const SolveOptions &options;
+    Cube goal;
+    u64 nodes{0};
+    Budget budget;
+    // Lookups that can be used, the databases are polled every 64K nodes.
+    u32 ready{0};
+    u64 next_poll{0};
+
+    // With SolveOptions::adaptive the lookups are ordered per slack by their
+    // cost per pruned child: the measured cycles per lookup divided by the
+    // fraction of the children it pruned at that slack. The order is updated
+    // whenever the databases are polled.
+    u8 order[MAX_SLACK][NUM_LOOKUPS];
+    u64 looked[MAX_SLACK][NUM_LOOKUPS]{};
+    u64 pruned[MAX_SLACK][NUM_LOOKUPS]{};
+    u64 cycles[NUM_LOOKUPS]{};
+    u64 timed[NUM_LOOKUPS]{};
+    u32 expansions{0};
+    // With SolveOptions::fringe_memory, see fringe.cpp.
+    Fringe fringe;
+    u32 fringe_goal{0};
+    // With SolveOptions::symmetric, fetched once instead of per node.
+    const Symmetries *symmetries{nullptr};
+    // Nodes and siblings cut off by BPMX, per iteration.
+    u64 bpmx_cutoffs{0};
+    // Set by Dfs() when it returns g + h of the node's own lookups, a lower
+    // bound of every solution through it, which the bound returned by a
+    // searched subtree is not: kValidMoves pruned part of it.
+    bool heuristic_cut{false};
+    // With SolveOptions::table_memory, or the one the work units share.
+    TranspositionTable own_table;
+    TranspositionTable *table{nullptr};
+    u64 table_probes{0}, table_hits{0};
+    // See GoalMoves().
+    Cube near_goal[18];
+
+    Search(const DatabaseSet &dbs, const SolveOptions &options)
+        : dbs(dbs), options(options) {
+        Init(goal);
+        for (s32 m = 0; m < 18; m++) {
+            for (s32 k = 0; k < 18; k++) {
+                Cube c = goal;
+                ApplyMove(c, k);
+                ApplyMove(c, m);
+                if (c == goal) {
+                    near_goal[m] = goal;
+                    ApplyMove(near_goal[m], k);
+                }
+            }
+        }
+        PollDatabases();
+        if (options.table_memory > 0 && own_table.Init(options.table_memory)) {
+            table = &own_table;
+        }
+        if (options.symmetric) {
+            symmetries = &GetSymmetries();
+        }
+        for (s32 s = 0; s < MAX_SLACK; s++) {
+            memcpy(order[s], kInitialOrder, NUM_LOOKUPS);
+        }
+    }
+
+    // Called every 64K nodes.
+    void Maintain() {
+        PollDatabases();
+        if (options.adaptive) {
+            Reorder();
+        }
+    }
+
+    void Reorder() {
+        f64 cost[NUM_LOOKUPS];
+        for (s32 d = 0; d < NUM_LOOKUPS; d++) {
+            cost[d] = (cycles[d] + 50.0) / (timed[d] + 1);
+        }
+        for (s32 s = 0; s < MAX_SLACK; s++) {
+            f64 key[NUM_LOOKUPS];
+            for (s32 d = 0; d < NUM_LOOKUPS; d++) {
+                key[d] = cost[d] * (looked[s][d] + 2) / (pruned[s][d] + 1);
+            }
+            // insertion sort, the order is nearly the same every time
+            u8 *o = order[s];
+            for (s32 i = 1; i < NUM_LOOKUPS; i++) {
+                for (s32 j = i; j > 0 && key[o[j]] < key[o[j - 1]]; j--) {
+                    Swap(o[j], o[j - 1]);
+                }
+            }
+        }
+    }
+
+    void PollDatabases() {
+        next_poll = nodes + KiB(64);
+        const Database *db[] = {&dbs.corner, &dbs.edge1, &dbs.edge2, &dbs.perm};
+        u32 now = (1u << CORNER_ORI) | (1u << EDGE_ORI);
+        for (s32 d = 0; d < 4; d++) {
+            now |= u32(db[d]->Ready()) << d;
+        }
+        if (now != ready && ready != 0 && options.verbose) {
+            printf("%d/4 databases loaded\n", __builtin_popcount(now & 0xf));
+        }
+        ready = now;
+    }
+
+    bool OutOfBudget() {
+        if (budget.exhausted) {
+            return true;
+        }
+        u64 total = budget.spent + nodes;
+        if (budget.nodes && total >= budget.nodes) {
+            budget.exhausted = true;
+        } else if (budget.deadline > 0 && total >= budget.next_check) {
+            budget.next_check = total + KiB(64);
+            budget.exhausted = Now() >= budget.deadline;
+        }
+        return budget.exhausted;
+    }
+
+    u8 Heuristic(Cube cube, u8 g, u8 bound) const {
+        // we stop early if we exceed the bound. The databases are sorted from high
+        // to low on their mean value, after the cheap orientation tables. Any
+        // subset of them is admissible, so the ones that are still loading are
+        // skipped.
+        u8 h = Max(dbs.corner_ori[CornerOrientationIndex(cube)],
+                   dbs.edge_ori[EdgeOrientationIndex(cube)]);
+        if (g + 1 + h > bound) {
+            return h;
+        }
+        if (ready & 1) {
+            u64 index = dbs.corner.hdr->ordering == Database::LOCAL
+                            ? CornerLocalIndex(cube)
+                            : CornerIndex(cube);
+            h = Max(dbs.corner.Get(index), h);
+            if (g + 1 + h > bound) {
+                return h;
+            }
+        }
+        if (ready & 2) {
+            h = Max(dbs.edge1.Get(EdgeIndex<PICKED>(cube, 0)), h);
+            if (g + 1 + h > bound) {
+                return h;
+            }
+        }
+        if (ready & 4) {
+            h = Max(dbs.edge2.Get(EdgeIndex<PICKED>(cube, 12 - PICKED)), h);
+            if (g + 1 + h > bound) {
+                return h;
+            }
+        }
+        if (ready & 8) {
+            h = Max(dbs.perm.Get(PermutationIndex(cube)), h);
+        }
         return h;
     }
-    index = EdgeIndex<PICKED>(cube, 12 - PICKED);
-    h = Max(edge2db.Get(index), h);
-    if (g + 1 + h > bound) {
+
+    // The indices of `cube` in the databases, in DatabaseSet order.
+    void Indices(Cube cube, u64 index[NUM_DATABASES]) const {
+        index[0] = dbs.corner.hdr->ordering == Database::LOCAL
+                       ? CornerLocalIndex(cube)
+                       : CornerIndex(cube);
+        index[1] = EdgeIndex<PICKED>(cube, 0);
+        index[2] = EdgeIndex<PICKED>(cube, 12 - PICKED);
+        index[3] = PermutationIndex(cube);
+    }
+
+    // Heuristic() with the indices computed beforehand, so they could be
+    // prefetched.
+    u8 Heuristic(const Cube &cube, const u64 index[NUM_DATABASES], u8 g,
+                 u8 bound) const {
+        const Database *db[] = {&dbs.corner, &dbs.edge1, &dbs.edge2, &dbs.perm};
+        u8 h = Max(dbs.corner_ori[CornerOrientationIndex(cube)],
+                   dbs.edge_ori[EdgeOrientationIndex(cube)]);
+        for (s32 d = 0; d < NUM_DATABASES && g + 1 + h <= bound; d++) {
+            if (ready & (1u << d)) {
+                h = Max(db[d]->Get(index[d]), h);
+            }
+        }
         return h;
     }
-    index = PermutationIndex(cube);
-    h = Max(permdb.Get(index), h);
-    return h;
-}
 
-internal void MoveBestToFront(u8 *moves, u8 *heuristic, s32 i, s32 n) {
-    u8 *first_move = moves + i;
-    u8 *first_h = heuristic + i;
-    u8 *best_h = first_h;
-    u8 *best_move = first_move;
+    // Generates every valid child of `parent` and computes its heuristic. Like
+    // Heuristic() we stop looking up a child as soon as it exceeds the bound, but
+    // all lookups of one DB are prefetched together before any of them is used.
+    void GenerateChildren(const Cube &parent, u8 g, u8 bound, Children &c) {
+        ChildIndices idx;
+        ExpandChildren(parent, c, idx);
+        u32 todo = (1u << c.n) - 1;
+        s32 slack = Min(Max(s32(bound) - g - 1, 0), MAX_SLACK - 1);
+        if (options.adaptive && ++expansions % SAMPLE_INTERVAL == 0) {
+            Sample(idx, g, bound, c, slack);
+            return;
+        }
+        const u8 *o = options.adaptive ? order[slack] : kFixedOrder;
+        s32 n = options.adaptive ? NUM_LOOKUPS : NUM_DATABASES;
+        for (s32 k = 0; k < n && todo; k++) {
+            s32 d = o[k];
+            if (ready & (1u << d)) {
+                PrefetchChildren(d, idx, todo);
+                todo = LookupChildren(d, idx, g, bound, c, todo);
+            }
+        }
+    }
 
-    for (s32 j = i + 1; j < n; j++) {
-        if (heuristic[j] < *best_h) {
-            best_h = heuristic + j;
-            best_move = moves + j;
+    // Looks up all children in every lookup to measure their cost and how
+    // many children each prunes on its own.
+    void Sample(const ChildIndices &idx, u8 g, u8 bound, Children &c, s32 slack) {
+        u32 all = (1u << c.n) - 1;
+        u8 h[18] = {};
+        for (s32 d = 0; d < NUM_LOOKUPS; d++) {
+            if (!(ready & (1u << d))) {
+                continue;
+            }
+            memset(c.h, 0, sizeof(c.h));
+            u64 start = __rdtsc();
+            PrefetchChildren(d, idx, all);
+            u32 left = LookupChildren(d, idx, g, bound, c, all);
+            cycles[d] += __rdtsc() - start;
+            timed[d] += c.n;
+            looked[slack][d] += c.n;
+            pruned[slack][d] += __builtin_popcount(all & ~left);
+            for (s32 j = 0; j < c.n; j++) {
+                h[j] = Max(c.h[j], h[j]);
+            }
         }
+        memcpy(c.h, h, sizeof(h));
     }
 
-    Swap(*first_move, *best_move);
-    Swap(*first_h, *best_h);
-}
+    // The stages of GenerateChildren(), the batch solver yields to another
+    // search between the prefetch and the lookups of every database.
+    void ExpandChildren(const Cube &parent, Children &c, ChildIndices &idx) const {
+        u32 valid = kValidMoves[parent.GetLastMoveIndex()];
+        c.n = 0;
+        while (valid) {
+            s32 move = __builtin_ffs(valid) - 1;
+            c.cube[c.n] = parent;
+            ApplyMove(c.cube[c.n], move);
+            c.h[c.n] = 0;
+            valid &= valid - 1;
+            c.n++;
+        }
+        bool local_corners = dbs.corner.hdr->ordering == Database::LOCAL;
+        ComputeChildIndices(c, local_corners, idx);
+    }
 
-internal u8 Dfs(Cube *path, u8 g, u8 bound) {
-    if (path[g] == goal) {
-        return FOUND;
+    // The first database after `d` that is loaded, 4 if there is none or no
+    // child is left to look up.
+    s32 NextDatabase(s32 d, u32 todo) const {
+        d++;
+        while (todo && d < 4 && !(ready & (1u << d))) {
+            d++;
+        }
+        return todo ? d : 4;
     }
 
-    u8 min = NOT_FOUND, t = NOT_FOUND;
-    u32 valid = kValidMoves[path[g].GetLastMoveIndex()];
-    u8 heuristic[18];
-    u8 moves[18];
-    s32 n = 0;
+    void PrefetchChildren(s32 d, const ChildIndices &idx, u32 todo) const {
+        if (d >= CORNER_ORI) {
+            return;
+        }
+        const Database &db = dbs.Get(d);
+        const u64 *index = idx.Get(d);
+        for (u32 t = todo; t; t &= t - 1) {
+            db.Prefetch(index[__builtin_ctz(t)]);
+        }
+    }
+
+    // Returns the children that are still within the bound.
+    u32 LookupChildren(s32 d, const ChildIndices &idx, u8 g, u8 bound, Children &c,
+                       u32 todo) const {
+        const u64 *index = idx.Get(d);
+        if (d >= CORNER_ORI) {
+            const u8 *table = d == CORNER_ORI ? dbs.corner_ori : dbs.edge_ori;
+            for (u32 t = todo; t; t &= t - 1) {
+                s32 j = __builtin_ctz(t);
+                c.h[j] = Max(table[index[j]], c.h[j]);
+                if (g + 1 + c.h[j] > bound) {
+                    todo &= ~(1u << j);
+                }
+            }
+            return todo;
+        }
+        const Database &db = dbs.Get(d);
+        for (u32 t = todo; t; t &= t - 1) {
+            s32 j = __builtin_ctz(t);
+            c.h[j] = Max(db.Get(index[j]), c.h[j]);
+            if (g + 1 + c.h[j] > bound) {
+                todo &= ~(1u << j);
+            }
+        }
+        return todo;
+    }
 
-    // obtain all valid moves and their corresponding heuristic
-    while (valid) {
-        s32 move = __builtin_ffs(valid) - 1;
-        moves[n] = move;
-        path[g + 1] = path[g];
-        ApplyMove(path[g + 1], move);
-        heuristic[n] = Heuristic(path[g + 1], g, bound);
-        valid &= valid - 1;
-        n++;
+    // The states one move from the goal, the goal is reached from
+    // near_goal[m] with move m.
+    template <s32 M = 0>
+    u32 GoalMoves(const Cube &cube) const {
+        if constexpr (M == 18) {
+            return 0;
+        } else {
+            return u32(cube == near_goal[M]) << M | GoalMoves<M + 1>(cube);
+        }
     }
 
-    nodes += n;
+    // Dfs() for the last R plies of an iteration, which make up most of its
+    // nodes. A child on the last ply is within the bound only at h == 0, so
+    // instead of generating it, looking it up and recursing to test it, the
+    // node is compared with the states next to the goal, with the move loop
+    // unrolled. No DB is consulted there, the cut off children get the
+    // smallest f they can have. The plies before it skip the move ordering,
+    // which only matters in the last iteration.
+    template <s32 R>
+    u8 DfsTail(Cube *path, u8 g, u8 bound) {
+        if (path[g] == goal) {
+            return FOUND;
+        }
+        if (OutOfBudget()) {
+            return ABORTED;
+        }
+        if (nodes >= next_poll) {
+            Maintain();
+        }
+        if constexpr (R == 1) {
+            u32 valid = kValidMoves[path[g].GetLastMoveIndex()];
+            nodes += __builtin_popcount(valid);
+            u32 found = GoalMoves(path[g]) & valid;
+            if (found) {
+                path[g + 1] = path[g];
+                ApplyMove(path[g + 1], __builtin_ctz(found));
+                return FOUND;
+            }
+            return g + 2;
+        } else {
+            u8 min = NOT_FOUND;
+            Children children;
+            GenerateChildren(path[g], g, bound, children);
+            nodes += children.n;
+            for (s32 i = 0; i < children.n; i++) {
+                u8 f = g + 1 + children.h[i];
+                if (f > bound) {
+                    min = Min(f, min);
+                    continue;
+                }
+                path[g + 1] = children.cube[i];
+                u8 t = DfsTail<R - 1>(path, g + 1, bound);
+                if (t == FOUND || t == ABORTED) {
+                    return t;
+                }
+                min = Min(t, min);
+            }
+            return min;
+        }
+    }
 
-    // shift the best move to the front, best being the lowest h-cost move
-    for (s32 i = 0; i < n; i++) {
-        MoveBestToFront(moves, heuristic, i, n);
-        if (g + 1 + heuristic[i] > bound) {
-            return g + 1 + heuristic[i];
+    u8 Dfs(Cube *path, u8 g, u8 bound) {
+        switch (s32(bound) - g) {
+            case 1: return DfsTail<1>(path, g, bound);
+            case 2: return DfsTail<2>(path, g, bound);
+            case 3: return DfsTail<3>(path, g, bound);
         }
-        path[g + 1] = path[g];
-        ApplyMove(path[g + 1], moves[i]);
-        t = Dfs(path, g + 1, bound);
-        if (t == FOUND) {
+        if (path[g] == goal) {
             return FOUND;
         }
-        min = Min(t, min);
+        if (OutOfBudget()) {
+            return ABORTED;
+        }
+        if (nodes >= next_poll) {
+            Maintain();
+        }
+
+        u8 min = NOT_FOUND, t = NOT_FOUND;
+        Children children;
+
+        if (table && g > 0) {
+            table_probes++;
+            if (table->Visit(path[g], g, bound)) {
+                table_hits++;
+                return NOT_FOUND;
+            }
+        }
+
+        // The rotated cube has the same distance, its h may be larger.
+        u8 h = 0;
+        if (options.symmetric && g > 0) {
+            h = SymmetricHeuristic(path[g], g, bound);
+            if (g + h > bound) {
+                heuristic_cut = true;
+                return g + h;
+            }
+        }
+        // The inverse cube has the same distance too. Its h is not consistent
+        // with those of the neighbors, which is what BPMX propagates.
+        if (options.bpmx && g > 0) {
+            h = Max(InverseHeuristic(path[g], g, bound), h);
+            if (g + h > bound) {
+                heuristic_cut = true;
+                return g + h;
+            }
+        }
+
+        // obtain all valid children and their corresponding heuristic
+        GenerateChildren(path[g], g, bound, children);
+        nodes += children.n;
+
+        // BPMX: h differs by at most one between neighbors, so the node's h
+        // is at least that of any child minus one and the other way round.
+        if (options.bpmx) {
+            u8 hmax = 0;
+            for (s32 i = 0; i < children.n; i++) {
+                hmax = Max(children.h[i], hmax);
+            }
+            if (g + hmax > bound + 1) {
+                bpmx_cutoffs++;
+                heuristic_cut = true;
+                return g + hmax - 1;
+            }
+            for (s32 i = 0; h > 1 && i < children.n; i++) {
+                children.h[i] = Max(children.h[i], u8(h - 1));
+            }
+        }
+
+        for (s32 i = 0; table && i < children.n; i++) {
+            if (g + 1 + children.h[i] <= bound) {
+                table->Prefetch(children.cube[i]);
+            }
+        }
+
+        // shift the best child to the front, best being the lowest h-cost move
+        for (s32 i = 0; i < children.n; i++) {
+            MoveBestToFront(children, i);
+            if (g + 1 + children.h[i] > bound) {
+                return Min(u8(g + 1 + children.h[i]), min);
+            }
+            path[g + 1] = children.cube[i];
+            heuristic_cut = false;
+            t = Dfs(path, g + 1, bound);
+            if (t == FOUND || t == ABORTED) {
+                return t;
+            }
+            // A child cut off by its own h, not by the bound of a searched
+            // subtree, proves the node's h is at least that h minus one, too
+            // large for its other children.
+            if (options.bpmx && heuristic_cut && t > bound + 2 &&
+                i + 1 < children.n) {
+                bpmx_cutoffs++;
+                return t - 2;
+            }
+            heuristic_cut = false;
+            min = Min(t, min);
+        }
+        return min;
     }
-    return min;
-}
 
-internal bool IDAStar(Cube root) {
-    timespec start, end;
-    Cube path[20];
-    u8 bound = Heuristic(root, 0, 255);
-    path[0] = root;
-    while (true) {
-        nodes = 0;
-        clock_gettime(CLOCK_MONOTONIC, &start);
-        u8 t = Dfs(path, 0, bound);
-        clock_gettime(CLOCK_MONOTONIC, &end);
-        f64 elapsed = Timespec2Sec(&end) - Timespec2Sec(&start);
-        printf("T%5.3f B:%02u N/s:%'lu N:%'lu\n", elapsed, bound,
-               u64(nodes / elapsed), nodes);
-        if (t == FOUND) {
-            // print path
-            s32 depth = 1;
-            printf("\n");
-            while (true) {
-                auto move = path[depth].GetLastMoveIndex() - 1;
-                printf("%s ", kNames[move]);
-                kMoves[move](root);
-                if (path[depth] == goal) {
+    // Heuristic() of the node on the cube rotated by SYMMETRIC_LOOKUP, whose
+    // distance is the same.
+    u8 SymmetricHeuristic(const Cube &cube, u8 g, u8 bound) const {
+        Cube rotated = Conjugate(cube, SYMMETRIC_LOOKUP, *symmetries);
+        return Heuristic(rotated, g - 1, bound);
+    }
+
+    // Heuristic() of the node on its inverse cube, the dual lookup.
+    u8 InverseHeuristic(const Cube &cube, u8 g, u8 bound) const {
+        return Heuristic(Inverse(cube), g - 1, bound);
+    }
+
+    // Dfs() that keeps the children it cuts off in the fringe, along with a
+    // node for every state it expands. `node` is the one of `cube`.
+    u8 FringeDfs(const Cube &cube, u32 node, u8 g, u8 bound) {
+        if (cube == goal) {
+            fringe_goal = node;
+            return FOUND;
+        }
+        if (OutOfBudget()) {
+            return ABORTED;
+        }
+        if (nodes >= next_poll) {
+            Maintain();
+        }
+
+        u8 min = NOT_FOUND, t = NOT_FOUND;
+        Children children;
+        GenerateChildren(cube, g, bound, children);
+        nodes += children.n;
+
+        for (s32 i = 0; i < children.n; i++) {
+            MoveBestToFront(children, i);
+            if (g + 1 + children.h[i] > bound) {
+                // the rest of the children are at least as far
+                for (s32 j = i; j < children.n; j++) {
+                    if (!fringe.Keep(children.cube[j], node, g + 1,
+                                     children.h[j])) {
+                        return FRINGE_FULL;
+                    }
+                }
+                return Min(u8(g + 1 + children.h[i]), min);
+            }
+            u32 child =
+                fringe.AddNode(node, children.cube[i].GetLastMoveIndex() - 1);
+            if (child == FRINGE_MAX_NODES) {
+                return FRINGE_FULL;
+            }
+            t = FringeDfs(children.cube[i], child, g + 1, bound);
+            if (t == FOUND || t == ABORTED || t == FRINGE_FULL) {
+                return t;
+            }
+            min = Min(t, min);
+        }
+        return min;
+    }
+
+    // An iteration that continues from the fringe of the previous one. An
+    // entry that is still beyond the bound is kept for the next iteration.
+    // The entries are looked up again with the new bound, in batches whose
+    // lookups are all prefetched first, like the children of a node.
+    u8 FringeIteration(u8 bound) {
+        const Database *db[] = {&dbs.corner, &dbs.edge1, &dbs.edge2, &dbs.perm};
+        u64 index[FRINGE_BATCH][NUM_DATABASES];
+        fringe.Advance();
+        u8 min = NOT_FOUND;
+        for (u64 i = 0; i < fringe.num_now; i++) {
+            FringeEntry e = fringe.now[i];
+            u64 k = i % FRINGE_BATCH;
+            if (k == 0) {
+                u64 end = Min(i + FRINGE_BATCH, fringe.num_now);
+                for (u64 j = i; j < end; j++) {
+                    const FringeEntry &f = fringe.now[j];
+                    if (f.g + f.h > bound) {
+                        continue;
+                    }
+                    Indices(f.cube, index[j - i]);
+                    for (s32 d = 0; d < NUM_DATABASES; d++) {
+                        if (ready & (1u << d)) {
+                            db[d]->Prefetch(index[j - i][d]);
+                        }
+                    }
+                }
+            }
+            if (e.g + e.h <= bound) {
+                e.h = Max(e.h, Heuristic(e.cube, index[k], e.g - 1, bound));
+            }
+            if (e.g + e.h > bound) {
+                if (!fringe.Keep(e.cube, e.parent, e.g, e.h)) {
+                    return FRINGE_FULL;
+                }
+                min = Min(u8(e.g + e.h), min);
+                continue;
+            }
+            u32 node = fringe.AddNode(e.parent, e.cube.GetLastMoveIndex() - 1);
+            if (node == FRINGE_MAX_NODES) {
+                return FRINGE_FULL;
+            }
+            u8 t = FringeDfs(e.cube, node, e.g, bound);
+            if (t == FOUND || t == ABORTED || t == FRINGE_FULL) {
+                return t;
+            }
+            min = Min(t, min);
+        }
+        return min;
+    }
+
+    // Weighted IDA*, where f = g + weight * h. Costs are in 1/4 moves so the
+    // weight can be fractional. Finds a solution of at most weight times the
+    // optimal length.
+    u32 WeightedDfs(Cube *path, u8 g, u32 bound, u32 weight, s32 limit) {
+        if (path[g] == goal) {
+            return WEIGHTED_FOUND;
+        }
+        if (g + 1 >= limit) {
+            return WEIGHTED_NOT_FOUND;
+        }
+        if (OutOfBudget()) {
+            return WEIGHTED_ABORTED;
+        }
+        if (nodes >= next_poll) {
+            Maintain();
+        }
+
+        u32 min = WEIGHTED_NOT_FOUND, t;
+        Children children;
+        GenerateChildren(path[g], g, NOT_FOUND, children);
+        nodes += children.n;
+
+        for (s32 i = 0; i < children.n; i++) {
+            MoveBestToFront(children, i);
+            u32 f = 4 * (g + 1) + weight * children.h[i];
+            if (f > bound) {
+                return Min(f, min);
+            }
+            path[g + 1] = children.cube[i];
+            t = WeightedDfs(path, g + 1, bound, weight, limit);
+            if (t == WEIGHTED_FOUND || t == WEIGHTED_ABORTED) {
+                return t;
+            }
+            min = Min(t, min);
+        }
+        return min;
+    }
+
+    // Knuth's estimate of the nodes Dfs() generates with this bound: a probe
+    // walks down a random path of the tree, choosing uniformly among the
+    // children that Dfs() would recurse into, and every level contributes the
+    // children it generated times the inverse probability of reaching it.
+    // Returns the mean over all probes, `generated` counts their own nodes.
+    f64 Sample(Cube root, u8 bound, u32 probes, u32 &seed, u64 &generated) {
+        f64 sum = 0;
+        generated = 0;
+        for (u32 p = 0; p < probes; p++) {
+            Cube cube = root;
+            f64 weight = 1;
+            for (u8 g = 0; g < MAX_DEPTH - 1 && !(cube == goal); g++) {
+                Children children;
+                GenerateChildren(cube, g, bound, children);
+                generated += children.n;
+                sum += weight * children.n;
+                s32 k = 0;
+                for (s32 i = 0; i < children.n; i++) {
+                    if (g + 1 + children.h[i] <= bound) {
+                        children.cube[k++] = children.cube[i];
+                    }
+                }
+                if (k == 0) {
                     break;
                 }
-                depth++;
+                cube = children.cube[rand_r(&seed) % k];
+                weight *= k;
             }
-            printf("(%d)\n", depth);
-            PrettyPrint(root);
-            return true;
         }
-        if (t == NOT_FOUND) {
+        return sum / Max(probes, 1u);
+    }
+
+    // The time is extrapolated from the speed of the probes, which is somewhat
+    // slower than Dfs() as they hardly ever hit the cache.
+    IterationEstimate Estimate(Cube root, u8 bound, const EffortPredictor &predictor,
+                               u32 probes, u32 &seed) {
+        IterationEstimate e;
+        e.bound = bound;
+        e.korf = predictor.Nodes(bound);
+        e.sampled = 0;
+        e.seconds = 0;
+        if (probes > 0) {
+            u64 generated;
+            f64 start = Now();
+            e.sampled = Sample(root, bound, probes, seed, generated);
+            e.seconds = e.sampled * (Now() - start) / Max(generated, u64(1));
+        }
+        return e;
+    }
+
+    void ExtractSolution(const Cube *path, Solution &solution) {
+        s32 depth = 0;
+        while (!(path[depth] == goal)) {
+            depth++;
+            solution.moves[depth - 1] = path[depth].GetLastMoveIndex() - 1;
+        }
+        solution.length = depth;
+    }
+
+    // Only looks for solutions shorter than the given one, if any.
+    bool WeightedIDAStar(Cube root, f64 weight, Solution &solution) {
+        f64 start = Now();
+        Cube path[MAX_DEPTH];
+        u32 w = Max(u32(weight * 4 + 0.5), 4u);
+        u32 bound = w * Heuristic(root, 0, NOT_FOUND);
+        s32 limit = solution.length >= 0 ? solution.length : MAX_DEPTH;
+        bool found = false;
+        path[0] = root;
+        nodes = 0;
+        PollDatabases();
+        while (true) {
+            u32 t = WeightedDfs(path, 0, bound, w, limit);
+            if (t == WEIGHTED_FOUND) {
+                ExtractSolution(path, solution);
+                if (options.verbose) {
+                    printf("W%5.3f w:%0.2f N:%'lu found %d moves\n",
+                           Now() - start, w / 4.0, nodes, solution.length);
+                }
+                found = true;
+                break;
+            }
+            if (t == WEIGHTED_ABORTED || t == WEIGHTED_NOT_FOUND) {
+                break;
+            }
+            bound = t;
+        }
+        budget.spent += nodes;
+        return found;
+    }
+
+    // IDA* that stops when the options' time or node limit is exhausted. With a
+    // limit set, weighted searches with decreasing weights first find a solution
+    // to fall back on, the optimal search then either improves on it or proves it
+    // optimal once its bound reaches the solution length.
+    Solution IDAStar(Cube root) {
+        Solution best;
+        Cube path[MAX_DEPTH];
+        f64 start = Now();
+        // The move that scrambled the root must not restrict the first move
+        // of the solution, see kValidMoves.
+        root.SetLastMoveIndex(0);
+        path[0] = root;
+
+        budget = Budget();
+        if (options.time_limit > 0 || options.node_limit > 0) {
+            // The weights are tried in turn, each with an equal slice of the
+            // share, since which weight finds a solution quickly is erratic.
+            f64 weights[8];
+            s32 n = 0;
+            for (f64 w = Max(options.weight, 1.25); w >= 1.25 && n < 8;
+                 w = 1 + (w - 1) / 2) {
+                weights[n++] = w;
+            }
+            for (s32 i = 0; i < n; i++) {
+                f64 slice = ANYTIME_SHARE / n;
+                budget.exhausted = false;
+                budget.nodes = budget.spent + options.node_limit * slice;
+                budget.nodes = options.node_limit > 0 ? budget.nodes : 0;
+                budget.deadline = options.time_limit > 0
+                                      ? Now() + options.time_limit * slice
+                                      : 0;
+                WeightedIDAStar(root, weights[i], best);
+            }
+            budget.exhausted = false;
+            budget.nodes = options.node_limit;
+            budget.deadline = options.time_limit > 0 ? start + options.time_limit : 0;
+        }
+
+        u8 bound = Heuristic(root, 0, NOT_FOUND);
+        u32 seed = 1;
+        // only printed with verbose, otherwise not worth their syscalls
+        PerfCounters perf(options.verbose);
+        u64 misses[PerfCounters::NUM_COUNTERS]{};
+        // The first iteration starts from the root. In fringe mode, IDA* would
+        // regenerate all nodes of the previous iterations in every iteration.
+        bool use_fringe =
+            options.fringe_memory > 0 && fringe.Reset(options.fringe_memory);
+        bool first = true;
+        u64 saved_nodes = 0;
+        f64 saved_time = 0;
+        while (true) {
+            if (best.length >= 0 && bound >= best.length) {
+                // nothing shorter than the bound exists
+                best.optimal = true;
+                break;
+            }
+
+            if (options.verbose && options.predictor) {
+                IterationEstimate e =
+                    Estimate(root, bound, *options.predictor, options.probes, seed);
+                printf("P B:%02u Korf:%'.0f Knuth:%'.0f S:%0.3f\n", bound, e.korf,
+                       e.sampled, e.seconds);
+            }
+
+            nodes = 0;
+            bpmx_cutoffs = 0;
+            table_probes = table_hits = 0;
+            PollDatabases();
+            f64 begin = Now();
+            if (options.verbose) {
+                perf.Lap(misses);
+            }
+            u8 t;
+            if (use_fringe) {
+                t = first ? FringeDfs(root, 0, 0, bound)
+                          : FringeIteration(bound);
+                if (t == FRINGE_FULL) {
+                    if (options.verbose) {
+                        printf("fringe exceeds %'lu MiB, back to IDA*\n",
+                               u64(options.fringe_memory / MiB(1)));
+                    }
+                    fringe.Free();
+                    use_fringe = false;
+                    t = Dfs(path, 0, bound);
+                }
+            } else {
+                t = Dfs(path, 0, bound);
+            }
+            first = false;
+            if (options.verbose) {
+                perf.Lap(misses);
+            }
+            f64 elapsed = Now() - begin;
+            budget.spent += nodes;
+            if (options.verbose) {
+                printf("T%5.3f B:%02u N/s:%'lu N:%'lu", elapsed, bound,
+                       u64(nodes / elapsed), nodes);
+                if (perf.Available()) {
+                    printf(" LLC/N:%0.3f dTLB/N:%0.3f",
+                           misses[PerfCounters::LLC_MISSES] / f64(nodes),
+                           misses[PerfCounters::DTLB_MISSES] / f64(nodes));
+                }
+                if (options.bpmx) {
+                    printf(" BPMX:%'lu", bpmx_cutoffs);
+                }
+                if (table) {
+                    printf(" TT:%0.1f%%",
+                           100.0 * table_hits / Max(table_probes, u64(1)));
+                }
+                if (use_fringe) {
+                    printf(" F:%'lu MiB:%lu saved N:%'lu S:%0.3f",
+                           fringe.num_next, u64(fringe.used / MiB(1)),
+                           saved_nodes, saved_time);
+                }
+                printf("\n");
+            }
+            saved_nodes += nodes;
+            saved_time += elapsed;
+            if (t == FOUND && use_fringe) {
+                best.length = fringe.Trace(fringe_goal, best.moves);
+                best.optimal = true;
+                break;
+            }
+            if (t == FOUND) {
+                ExtractSolution(path, best);
+                best.optimal = true;
+                break;
+            }
+            if (t == ABORTED) {
+                if (options.verbose) {
+                    printf("budget exhausted after %0.3fs and %'lu nodes\n",
+                           Now() - start, budget.spent);
+                }
+                break;
+            }
+            if (t == NOT_FOUND) {
+                break;
+            }
+            bound = t;
+        }
+        best.nodes = budget.spent;
+        return best;
+    }
+
+    // Bidirectional search for solutions of up to BIDIR_MAX_DEPTH moves, see
+    // bidir.cpp. False if there is none or the tables would exceed
+    // SolveOptions::bidir_memory.
+    bool Bidirectional(Cube root, Solution &solution) {
+        f64 start = Now();
+        nodes = 0;
+        // from the root and from the goal
+        StateTable side[2];
+        root.SetLastMoveIndex(0);
+        Cube origin[2] = {root, goal};
+        for (s32 s = 0; s < 2; s++) {
+            if (!side[s].Allocate(BIDIR_MIN_SLOTS)) {
+                return false;
+            }
+            side[s].Insert(origin[s], 0);
+            side[s].last = 1;
+        }
+        bool found = root == goal;
+        Cube meet = root;
+        while (!found && side[0].depth + side[1].depth < BIDIR_MAX_DEPTH) {
+            s32 s = side[1].last < side[0].last;
+            StateTable &t = side[s];
+            const StateTable &other = side[!s];
+            // a state has at most 15 children after its first move, the
+            // table is kept at most half full
+            u64 n = t.mask + 1;
+            while ((t.size + t.last * 15) * 2 > n) {
+                n *= 2;
+            }
+            if (n > t.mask + 1 &&
+                (n * sizeof(Cube) + other.Bytes() > options.bidir_memory ||
+                 !t.Allocate(n))) {
+                if (options.verbose) {
+                    printf("bidirectional search exceeds %'lu MiB, back to "
+                           "IDA*\n",
+                           u64(options.bidir_memory / MiB(1)));
+                }
+                return false;
+            }
+            u8 depth = t.depth + 1;
+            u64 added = 0;
+            for (u64 i = 0; i <= t.mask && !found; i++) {
+                Cube parent = t.slots[i];
+                if (parent.corners == 0 ||
+                    StateTable::Depth(parent) != t.depth) {
+                    continue;
+                }
+                u32 valid = StateTable::Allowed(parent);
+                parent.corners &= (1ull << BIDIR_FACE_SHIFT) - 1;
+                while (valid) {
+                    s32 move = __builtin_ffs(valid) - 1;
+                    valid &= valid - 1;
+                    Cube child = parent;
+                    ApplyMove(child, move);
+                    nodes++;
+                    if (t.Insert(child, depth)) {
+                        added++;
+                        if (other.Find(child)) {
+                            found = true;
+                            meet = child;
+                            break;
+                        }
+                    }
+                }
+            }
+            t.depth = depth;
+            t.last = added;
+            if (options.verbose) {
+                printf("M%5.3f %s D:%u+%u N:%'lu states:%'lu MiB:%lu\n",
+                       Now() - start, s ? "goal" : "root", side[0].depth,
+                       side[1].depth, nodes, side[0].size + side[1].size,
+                       u64((side[0].Bytes() + side[1].Bytes()) / MiB(1)));
+            }
+        }
+        if (!found) {
+            if (options.verbose) {
+                printf("no solution within %d moves, back to IDA*\n",
+                       BIDIR_MAX_DEPTH);
+            }
             return false;
         }
-        bound = t;
+        // the moves from the goal to the meeting state are undone in reverse
+        u8 back[MAX_DEPTH];
+        s32 n = side[0].Trace(meet, solution.moves);
+        s32 m = side[1].Trace(meet, back);
+        for (s32 k = 0; k < m; k++) {
+            solution.moves[n + k] = InverseMove(back[m - 1 - k]);
+        }
+        solution.length = n + m;
+        solution.optimal = true;
+        solution.nodes = nodes;
+        return true;
+    }
+
+    // A* with the open list capped at SolveOptions::astar_memory, see
+    // astar.cpp. Lookups stop at the f of the expanded node as in Dfs(), so
+    // a child above it is pushed with a lower bound and marked lazy. Its h is
+    // completed when it comes off the heap, most of them never do. If the
+    // open list exceeds the cap, the search starts over with IDAStar().
+    Solution AStar(Cube root) {
+        Solution best;
+        f64 start = Now();
+        nodes = 0;
+        root.SetLastMoveIndex(0);
+        PollDatabases();
+        OpenList open;
+        u8 bound = Heuristic(root, 0, NOT_FOUND);
+        bool ok = open.Reset(options.astar_memory) &&
+                  open.Push(root, 0, 0, ASTAR_KEY(bound, 0, false));
+        f64 begin = start;
+        u64 begin_nodes = 0;
+        while (ok && open.heap.size > 0) {
+            HeapEntry e = open.heap.Pop();
+            const AStarNode n = open.nodes[e.node];
+            u8 f = e.key >> 6;
+            if (e.key & 1) {
+                u8 h = Heuristic(n.cube, n.g - 1, NOT_FOUND);
+                if (n.g + h > f) {
+                    ok = open.Push(e.node, ASTAR_KEY(n.g + h, n.g, false));
+                    continue;
+                }
+            }
+            if (f > bound) {
+                if (options.verbose) {
+                    f64 elapsed = Now() - begin;
+                    printf("A%5.3f B:%02u N/s:%'lu N:%'lu open:%'lu MiB:%lu\n",
+                           elapsed, bound,
+                           u64((nodes - begin_nodes) / Max(elapsed, 1e-9)),
+                           nodes - begin_nodes, open.heap.size,
+                           u64(open.used / MiB(1)));
+                }
+                begin = Now();
+                begin_nodes = nodes;
+                bound = f;
+            }
+            if (n.cube == goal) {
+                best.length = open.Trace(e.node, best.moves);
+                best.optimal = true;
+                break;
+            }
+            if (nodes >= next_poll) {
+                Maintain();
+            }
+            Children children;
+            GenerateChildren(n.cube, n.g, f, children);
+            nodes += children.n;
+            for (s32 i = 0; ok && i < children.n; i++) {
+                u8 g = n.g + 1, cf = g + children.h[i];
+                ok = open.Push(children.cube[i], e.node, g,
+                               ASTAR_KEY(cf, g, cf > f));
+            }
+        }
+        if (!ok) {
+            if (options.verbose) {
+                printf("A* exceeds %'lu MiB after %'lu nodes, back to IDA*\n",
+                       u64(options.astar_memory / MiB(1)), nodes);
+            }
+            u64 spent = nodes;
+            open.Free();
+            best = IDAStar(root);
+            best.nodes += spent;
+            return best;
+        }
+        if (options.verbose) {
+            printf("A%5.3f B:%02u N:%'lu open:%'lu MiB:%lu\n", Now() - start,
+                   bound, nodes, open.heap.size, u64(open.used / MiB(1)));
+        }
+        best.nodes = nodes;
+        return best;
+    }
+};
+
+Solution Solver::Solve(Cube root, const SolveOptions &options) const {
+    Solution solution;
+    // a root built with ApplyMove() still holds its last move
+    root.SetLastMoveIndex(0);
+    if (cache_ && cache_->Lookup(root, solution)) {
+        solution.cached = true;
+        return solution;
+    }
+    Search search(dbs_, options);
+    // A* has no anytime mode, the limits are left to IDAStar()
+    bool astar = options.astar_memory > 0 && options.time_limit <= 0 &&
+                 options.node_limit == 0;
+    if (options.bidir_memory == 0 || !search.Bidirectional(root, solution)) {
+        u64 spent = search.nodes;
+        solution = astar ? search.AStar(root) : search.IDAStar(root);
+        solution.nodes += spent;
+    }
+    if (cache_) {
+        cache_->Insert(root, solution);
+    }
+    return solution;
+}
+
+void Solver::Estimate(Cube root, const EffortPredictor &predictor, u32 probes,
+                      IterationEstimate *out, s32 n) const {
+    SolveOptions options;
+    Search search(dbs_, options);
+    u32 seed = 1;
+    u8 bound = search.Heuristic(root, 0, NOT_FOUND);
+    for (s32 i = 0; i < n && bound + i < MAX_DEPTH; i++) {
+        out[i] = search.Estimate(root, bound + i, predictor, probes, seed);
     }
-    return false;
 }
@@ -0,0 +1,519 @@
+#pragma once
+
+/// Sharded generation of a database by several processes, which may run on
+/// different machines that share a directory. Shard k of n owns the entries
+/// [ShardBegin(k), ShardBegin(k + 1)) and they search breadth-first in
+/// lockstep, with two rounds per depth:
+///
+///   1. Every shard writes what the others need from it and then publishes
+///      `d<depth>.<k>.ready`. Top-down, that is the children of its frontier
+///      that another shard owns, spilled to `d<depth>.<k>.<to>`. Bottom-up, it
+///      is a bitmap of its frontier, `d<depth>.<k>.frontier`, as every shard
+///      needs the frontier of all of them to find parents.
+///   2. Once all shards are ready, every shard sets its new entries and
+///      publishes how many it found in `d<depth>.<k>.found`.
+///
+/// All shards read the same counts, so they agree on the mode of every depth
+/// and on when to stop. Files are written under a temporary name and renamed,
+/// so a marker that exists is complete. Every shard writes its range to
+/// `shard.<k>`, and MergeShards() assembles them into the database that Bfs()
+/// would have generated, byte for byte.
+///
+/// Every shard also creates `run.<k>` when it starts, which only
+/// MergeShards() removes. The markers of a run that was stopped or never
+/// merged would be taken for those of a new run, so a shard does not start
+/// while its `run.<k>` exists.
+
+#include <algorithm>
+#include <errno.h>
+
+#define SHARD_MAGIC 0xfeffc2fc
+#define MAX_SHARDS 256
+// Shard boundaries are a multiple of this, so a frontier bitmap is whole words.
+#define SHARD_ALIGN 64
+// Offsets spilled per target before they are sorted and written.
+#define SPILL_CHUNK MiB(1)
+
+struct ShardHeader {
+    u32 magic{SHARD_MAGIC};
+    Database::Type type{Database::INVALID};
+    u64 num_entries{0};
+    u64 begin{0};
+    u64 end{0};
+    s32 shard{0};
+    s32 shards{0};
+};
+
+internal u64 ShardBegin(u64 n, s32 k, s32 shards) {
+    if (k >= shards) {
+        return n;
+    }
+    return u64(f64(n) * k / shards) & ~u64(SHARD_ALIGN - 1);
+}
+
+internal s32 ShardOf(u64 i, u64 n, s32 shards) {
+    s32 k = Min(s32(f64(i) * shards / n), shards - 1);
+    while (i < ShardBegin(n, k, shards)) {
+        k--;
+    }
+    while (i >= ShardBegin(n, k + 1, shards)) {
+        k++;
+    }
+    return k;
+}
+
+internal void ShardPath(char *path, const char *dir, s64 depth, s32 k,
+                        const char *suffix) {
+    snprintf(path, 4096, "%s/d%02ld.%d.%s", dir, depth, k, suffix);
+}
+
+// Writes `size` bytes to `path` under a temporary name and renames it.
+internal bool Publish(const char *path, const void *data, u64 size) {
+    char tmp[4096 + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *file = fopen(tmp, "wb");
+    if (file == NULL) {
+        perror("fopen");
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp, path) == -1) {
+        perror("publish");
+        return false;
+    }
+    return true;
+}
+
+// Blocks until every shard published `suffix` for `depth`, and sums the
+// counts in them when `total` is set.
+internal void WaitForShards(const char *dir, s64 depth, s32 shards,
+                            const char *suffix, u64 *total) {
+    char path[4096];
+    for (s32 k = 0; k < shards; k++) {
+        ShardPath(path, dir, depth, k, suffix);
+        while (access(path, R_OK) != 0) {
+            usleep(10000);
+        }
+        if (total) {
+            FILE *file = fopen(path, "r");
+            u64 n = 0;
+            if (file == NULL || fscanf(file, "%lu", &n) != 1) {
+                fprintf(stderr, "could not read '%s'\n", path);
+            }
+            if (file) {
+                fclose(file);
+            }
+            *total += n;
+        }
+    }
+}
+
+struct Shard {
+    const char *dir;
+    s32 k;
+    s32 shards;
+    Indexer indexer{nullptr};
+    Unranker unrank{nullptr};
+    ShardHeader *hdr{nullptr};
+    // The entries of this shard, indexed from hdr->begin.
+    Database db;
+    Database::Header range;
+    // Spilled offsets per target shard, relative to its first entry.
+    u32 *spill[MAX_SHARDS]{};
+    u64 spilled[MAX_SHARDS]{};
+    FILE *spill_file[MAX_SHARDS]{};
+
+    u64 Begin() const { return hdr->begin; }
+    u64 End() const { return hdr->end; }
+
+    bool Open(Database::Type type) {
+        u64 n = 0;
+        switch (type) {
+            case Database::CORNER: n = Factorial(8) * Power(3, 7); break;
+            case Database::EDGE1:
+            case Database::EDGE2:
+                n = (Factorial(12) / Factorial(12 - PICKED)) * Power(2, PICKED);
+                break;
+            case Database::PERMUTATION: n = Factorial(12); break;
+            default: return false;
+        }
+        u64 begin = ShardBegin(n, k, shards);
+        u64 end = ShardBegin(n, k + 1, shards);
+        if (end - begin > u64(UINT32_MAX)) {
+            fprintf(stderr, "shards of %'lu entries need more than %d shards\n", n,
+                    shards);
+            return false;
+        }
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/shard.%d", dir, k);
+        s32 fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        u64 size = sizeof(ShardHeader) + (end - begin) / 2;
+        if (fd == -1 || ftruncate(fd, size) == -1) {
+            perror(path);
+            return false;
+        }
+        void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            return false;
+        }
+        hdr = (ShardHeader *)map;
+        *hdr = ShardHeader();
+        hdr->type = type;
+        hdr->num_entries = n;
+        hdr->begin = begin;
+        hdr->end = end;
+        hdr->shard = k;
+        hdr->shards = shards;
+
+        range.type = type;
+        range.num_entries = end - begin;
+        range.size = range.num_entries / 2;
+        db.hdr = &range;
+        db.data = (u8 *)map + sizeof(ShardHeader);
+        memset(db.data, 0xff, range.size);
+
+        indexer = IndexerFor(type);
+        unrank = UnrankerFor(type);
+        return true;
+    }
+
+    void Close() {
+        msync(hdr, sizeof(ShardHeader) + range.size, MS_SYNC);
+        munmap(hdr, sizeof(ShardHeader) + range.size);
+        for (s32 j = 0; j < shards; j++) {
+            free(spill[j]);
+        }
+    }
+
+    void Flush(s64 depth, s32 to) {
+        if (spilled[to] == 0) {
+            return;
+        }
+        if (spill_file[to] == NULL) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/d%02ld.%d.%d", dir, depth, k, to);
+            spill_file[to] = fopen(path, "wb");
+            if (spill_file[to] == NULL) {
+                perror(path);
+                exit(1);
+            }
+        }
+        // many parents share a child, sorting also makes the receiver's
+        // updates sequential
+        u32 *s = spill[to];
+        std::sort(s, s + spilled[to]);
+        u64 n = std::unique(s, s + spilled[to]) - s;
+        fwrite(s, sizeof(u32), n, spill_file[to]);
+        spilled[to] = 0;
+    }
+
+    // Expands the entries at depth - 1, returns the number of new entries
+    // this shard owns.
+    u64 TopDown(s64 depth) {
+        u64 found = 0;
+        u64 n = hdr->num_entries;
+        Cube cube;
+        Init(cube);
+        for (u64 i = 0; i < range.num_entries; i++) {
+            if (db.Get(i) != depth - 1) {
+                continue;
+            }
+            unrank(Begin() + i, cube);
+            for (s32 move = 0; move < 18; move++) {
+                Cube next = cube;
+                ApplyMove(next, move);
+                u64 index = indexer(next);
+                if (index >= Begin() && index < End()) {
+                    found += db.Update(index - Begin(), depth);
+                    continue;
+                }
+                s32 to = ShardOf(index, n, shards);
+                if (spill[to] == NULL) {
+                    spill[to] = (u32 *)malloc(SPILL_CHUNK * sizeof(u32));
+                }
+                spill[to][spilled[to]++] = index - ShardBegin(n, to, shards);
+                if (spilled[to] == SPILL_CHUNK) {
+                    Flush(depth, to);
+                }
+            }
+        }
+        for (s32 to = 0; to < shards; to++) {
+            Flush(depth, to);
+            if (spill_file[to]) {
+                fclose(spill_file[to]);
+                spill_file[to] = NULL;
+            }
+        }
+        return found;
+    }
+
+    // Applies the children that the other shards spilled to this one.
+    u64 Receive(s64 depth) {
+        u64 found = 0;
+        u32 *buffer = (u32 *)malloc(SPILL_CHUNK * sizeof(u32));
+        for (s32 from = 0; from < shards; from++) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/d%02ld.%d.%d", dir, depth, from, k);
+            FILE *file = fopen(path, "rb");
+            if (file == NULL) {
+                continue;
+            }
+            u64 n;
+            while ((n = fread(buffer, sizeof(u32), SPILL_CHUNK, file)) > 0) {
+                for (u64 j = 0; j < n; j++) {
+                    found += db.Update(buffer[j], depth);
+                }
+            }
+            fclose(file);
+            unlink(path);
+        }
+        free(buffer);
+        return found;
+    }
+
+    bool PublishFrontier(s64 depth) {
+        u64 words = range.num_entries / 64 + 1;
+        u64 *bits = (u64 *)calloc(words, sizeof(u64));
+        for (u64 i = 0; i < range.num_entries; i++) {
+            if (db.Get(i) == depth - 1) {
+                bits[i / 64] |= 1ull << (i % 64);
+            }
+        }
+        char path[4096];
+        ShardPath(path, dir, depth, k, "frontier");
+        bool ok = Publish(path, bits, words * sizeof(u64));
+        free(bits);
+        return ok;
+    }
+
+    // Sets the unvisited entries that have a neighbor in the frontier of all
+    // shards, returns how many.
+    u64 BottomUp(s64 depth) {
+        u64 n = hdr->num_entries;
+        u64 *frontier = (u64 *)calloc(n / 64 + 1, sizeof(u64));
+        for (s32 from = 0; from < shards; from++) {
+            char path[4096];
+            ShardPath(path, dir, depth, from, "frontier");
+            FILE *file = fopen(path, "rb");
+            u64 begin = ShardBegin(n, from, shards);
+            u64 words = (ShardBegin(n, from + 1, shards) - begin) / 64 + 1;
+            if (file == NULL ||
+                fread(frontier + begin / 64, sizeof(u64), words, file) != words) {
+                fprintf(stderr, "could not read '%s'\n", path);
+                exit(1);
+            }
+            fclose(file);
+        }
+
+        u64 found = 0;
+        Cube cube;
+        Init(cube);
+        for (u64 i = 0; i < range.num_entries; i++) {
+            if (db.Get(i) != 0xf) {
+                continue;
+            }
+            unrank(Begin() + i, cube);
+            for (s32 move = 0; move < 18; move++) {
+                Cube next = cube;
+                ApplyMove(next, move);
+                u64 index = indexer(next);
+                if (frontier[index / 64] >> (index % 64) & 1) {
+                    db.Update(i, depth);
+                    found++;
+                    break;
+                }
+            }
+        }
+        free(frontier);
+        return found;
+    }
+
+    // Removes what this shard published for `depth`, once no shard reads it.
+    void Cleanup(s64 depth) {
+        const char *suffixes[] = {"ready", "found", "frontier"};
+        for (const char *suffix : suffixes) {
+            char path[4096];
+            ShardPath(path, dir, depth, k, suffix);
+            unlink(path);
+        }
+    }
+
+    bool Run() {
+        timespec start, end;
+        u64 n = hdr->num_entries;
+        Cube root;
+        Init(root);
+        u64 solved = indexer(root);
+        if (solved >= Begin() && solved < End()) {
+            db.Update(solved - Begin(), 0);
+        }
+
+        u64 visited = 1, frontier = 1;
+        s64 depth = 0;
+        while (frontier && visited < n) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            depth++;
+            bool bottom_up = frontier * BOTTOM_UP_RATIO > n - visited;
+
+            char path[4096];
+            u64 found = 0;
+            if (bottom_up && !PublishFrontier(depth)) {
+                return false;
+            }
+            if (!bottom_up) {
+                found = TopDown(depth);
+            }
+            ShardPath(path, dir, depth, k, "ready");
+            if (!Publish(path, "", 0)) {
+                return false;
+            }
+            WaitForShards(dir, depth, shards, "ready", NULL);
+            if (depth > 1) {
+                Cleanup(depth - 1);
+            }
+            found += bottom_up ? BottomUp(depth) : Receive(depth);
+
+            char count[32];
+            s32 len = snprintf(count, sizeof(count), "%lu\n", found);
+            ShardPath(path, dir, depth, k, "found");
+            if (!Publish(path, count, len)) {
+                return false;
+            }
+            frontier = 0;
+            WaitForShards(dir, depth, shards, "found", &frontier);
+            visited += frontier;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            printf("Shard:%d/%d Depth:%02ld Time:%0.3f Mode:%s Found:%'lu "
+                   "Frontier:%'lu Todo:%'lu\n",
+                   k, shards, depth, Timespec2Sec(&end) - Timespec2Sec(&start),
+                   bottom_up ? "bottom-up" : "top-down", found, frontier,
+                   n - visited);
+        }
+        return true;
+    }
+};
+
+// Generates shard `k` of `shards` of a database into `dir`, in lockstep with
+// the processes that generate the other shards into the same directory. Fails
+// if the directory holds an earlier run of the shard that was not merged.
+internal bool GenerateShard(Database::Type type, const char *dir, s32 k,
+                            s32 shards) {
+    if (shards < 1 || shards > MAX_SHARDS || k < 0 || k >= shards) {
+        fprintf(stderr, "invalid shard %d of %d\n", k, shards);
+        return false;
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/run.%d", dir, k);
+    s32 fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd == -1) {
+        if (errno == EEXIST) {
+            fprintf(stderr,
+                    "'%s' holds an earlier run, merge or remove it first\n",
+                    dir);
+        } else {
+            perror(path);
+        }
+        return false;
+    }
+    close(fd);
+    Shard shard;
+    shard.dir = dir;
+    shard.k = k;
+    shard.shards = shards;
+    if (!shard.Open(type)) {
+        return false;
+    }
+    bool ok = shard.Run();
+    shard.Close();
+    return ok;
+}
+
+// Assembles the shards in `dir` into the database `out` and verifies that
+// they cover all entries, that every entry was visited and that the solved
+// state is the only one at depth 0. Removes the files of the last depth and
+// the markers of the run.
+internal bool MergeShards(const char *dir, const char *out) {
+    Database db;
+    ShardHeader first;
+    u64 next = 0;
+    bool ok = true;
+    for (s32 k = 0; ok && (k == 0 || k < first.shards); k++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/shard.%d", dir, k);
+        FILE *file = fopen(path, "rb");
+        ShardHeader hdr;
+        if (file == NULL || fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+            hdr.magic != SHARD_MAGIC) {
+            fprintf(stderr, "'%s' is not a shard\n", path);
+            if (file) {
+                fclose(file);
+            }
+            ok = false;
+            break;
+        }
+        if (k == 0) {
+            first = hdr;
+            ok = db.Alloc(hdr.num_entries, hdr.type);
+        }
+        if (ok && (hdr.type != first.type || hdr.num_entries != first.num_entries ||
+                   hdr.shards != first.shards || hdr.shard != k ||
+                   hdr.begin != next || hdr.end < hdr.begin)) {
+            fprintf(stderr, "'%s' does not match the other shards\n", path);
+            ok = false;
+        }
+        u64 size = (hdr.end - hdr.begin) / 2;
+        if (ok && fread(db.data + hdr.begin / 2, 1, size, file) != size) {
+            fprintf(stderr, "'%s' is truncated\n", path);
+            ok = false;
+        }
+        next = hdr.end;
+        fclose(file);
+    }
+    if (ok && next != first.num_entries) {
+        fprintf(stderr, "the shards end at %'lu of %'lu entries\n", next,
+                first.num_entries);
+        ok = false;
+    }
+
+    if (ok) {
+        u64 counts[16];
+        db.Histogram(counts);
+        Cube solved;
+        Init(solved);
+        if (counts[15] != 0) {
+            fprintf(stderr, "%'lu entries were never visited\n", counts[15]);
+            ok = false;
+        }
+        if (counts[0] != 1 || db.Get(IndexerFor(first.type)(solved)) != 0) {
+            fprintf(stderr, "the solved state must be the only entry at depth 0\n");
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        for (s64 depth = 1; depth < 16; depth++) {
+            for (s32 k = 0; k < first.shards; k++) {
+                const char *suffixes[] = {"ready", "found", "frontier"};
+                for (const char *suffix : suffixes) {
+                    char path[4096];
+                    ShardPath(path, dir, depth, k, suffix);
+                    unlink(path);
+                }
+            }
+        }
+        for (s32 k = 0; k < first.shards; k++) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/run.%d", dir, k);
+            unlink(path);
+        }
+        db.Write(out);
+    } else if (db.map) {
+        free(db.map);
+    }
+    return ok;
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+/// The 48 symmetries of the cube: 24 rotations, each with and without a
+/// mirror. Conjugating a cube by a symmetry rotates (and mirrors) the whole
+/// puzzle and then repaints it such that the centers have their usual colors
+/// again. Every solution of a cube, with its moves mapped by the same
+/// symmetry, solves the conjugated cube, so all conjugates share one optimal
+/// solution length.
+///
+/// A symmetry is a signed permutation of the axes x (L->R), y (D->U) and
+/// z (B->F). The tables are derived once from the sticker colors of the model,
+/// so they follow whatever orientation conventions CornerColor() and
+/// EdgeColor() use.
+
+#define NUM_SYMMETRIES 48
+
+struct Symmetries {
+    // Where a cubie at a slot ends up: slot (4 bits), cubie (4 bits) and
+    // orientation (1 or 2 bits), packed as slot << 8 | cubie << 4 | ori.
+    u16 corner[NUM_SYMMETRIES][8][8][3];
+    u16 edge[NUM_SYMMETRIES][12][12][2];
+    u8 move[NUM_SYMMETRIES][18];
+    u8 inverse[NUM_SYMMETRIES];
+};
+
+internal Cube Conjugate(const Cube &c, s32 s, const Symmetries &sym) {
+    Cube out;
+    out.corners = out.edges = 0;
+    for (s32 i = 0; i < 8; i++) {
+        u32 v = sym.corner[s][i][c.GetCornerPos(Corner(i))][c.GetCornerOri(Corner(i))];
+        out.SetCornerPos(Corner(v >> 8), (v >> 4) & 0xf);
+        out.SetCornerOri(Corner(v >> 8), v & 0xf);
+    }
+    for (s32 i = 0; i < 12; i++) {
+        u32 v = sym.edge[s][i][c.GetEdgePos(Edge(i))][c.GetEdgeOri(Edge(i))];
+        out.SetEdgePos(Edge(v >> 8), (v >> 4) & 0xf);
+        out.SetEdgeOri(Edge(v >> 8), v & 0xf);
+    }
+    return out;
+}
+
+// Slot positions in {-1, 0, 1}^3, see the indices in model.cpp.
+static const s8 kCornerPositions[8][3] = {{-1, 1, -1}, {1, 1, -1}, {1, 1, 1},
+                                          {-1, 1, 1},  {-1, -1, 1}, {-1, -1, -1},
+                                          {1, -1, -1}, {1, -1, 1}};
+static const s8 kEdgePositions[12][3] = {
+    {0, 1, -1}, {1, 1, 0},  {0, 1, 1},   {-1, 1, 0}, {1, 0, 1},   {-1, 0, 1},
+    {-1, 0, -1}, {1, 0, -1}, {0, -1, 1}, {-1, -1, 0}, {0, -1, -1}, {1, -1, 0}};
+// Axis of every sticker of a slot. Corners list theirs as Y, X, Z. Edges
+// start with the U or D sticker, or the F or B sticker for the middle layer.
+static const u8 kCornerAxes[3] = {1, 0, 2};
+internal void EdgeAxes(s32 edge, u8 axes[2]) {
+    const s8 *p = kEdgePositions[edge];
+    axes[0] = p[1] != 0 ? 1 : 2;
+    axes[1] = p[0] != 0 ? 0 : 2;
+}
+
+// Center color per axis and sign, +x being the right face.
+static const u8 kFaceColors[3][2] = {
+    {GREEN, BLUE}, {WHITE, YELLOW}, {RED, ORANGE}};
+
+struct Transform {
+    u8 perm[3];
+    s8 sign[3];
+    // the axis that axis i is mapped to
+    u8 to[3];
+
+    void Apply(const s8 in[3], s8 out[3]) const {
+        for (s32 i = 0; i < 3; i++) {
+            out[i] = sign[i] * in[perm[i]];
+        }
+    }
+};
+
+internal Transform SymmetryTransform(s32 s) {
+    static const u8 kPerms[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2},
+                                    {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+    Transform t;
+    for (s32 i = 0; i < 3; i++) {
+        t.perm[i] = kPerms[s / 8][i];
+        t.sign[i] = (s >> i) & 1 ? -1 : 1;
+        t.to[t.perm[i]] = i;
+    }
+    return t;
+}
+
+internal s32 FindSlot(const s8 (*positions)[3], s32 n, const s8 p[3]) {
+    for (s32 i = 0; i < n; i++) {
+        if (memcmp(positions[i], p, 3) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+internal Symmetries GenerateSymmetries() {
+    Symmetries sym;
+
+    for (s32 s = 0; s < NUM_SYMMETRIES; s++) {
+        Transform t = SymmetryTransform(s);
+        // The color of the center at n is repainted to that of the center at
+        // T(n). A sticker on axis a of a slot moves to axis t.to[a] of the
+        // slot at T(position).
+        u8 paint[6];
+        for (s32 axis = 0; axis < 3; axis++) {
+            for (s32 side = 0; side < 2; side++) {
+                s8 n[3] = {0, 0, 0}, m[3];
+                n[axis] = side ? 1 : -1;
+                t.Apply(n, m);
+                s32 to = t.to[axis];
+                paint[kFaceColors[axis][side]] = kFaceColors[to][m[to] > 0];
+            }
+        }
+
+        Cube c;
+        for (s32 i = 0; i < 8; i++) {
+            s8 p[3];
+            t.Apply(kCornerPositions[i], p);
+            s32 slot = FindSlot(kCornerPositions, 8, p);
+            for (s32 cubie = 0; cubie < 8; cubie++) {
+                for (s32 ori = 0; ori < 3; ori++) {
+                    s32 colors[3], want[3], got[3];
+                    Init(c);
+                    c.SetCornerPos(Corner(i), cubie);
+                    c.SetCornerOri(Corner(i), ori);
+                    CornerColor(c, Corner(i), colors);
+                    for (s32 k = 0; k < 3; k++) {
+                        want[kCornerAxes[t.to[kCornerAxes[k]]]] = paint[colors[k]];
+                    }
+                    sym.corner[s][i][cubie][ori] = 0xffff;
+                    for (s32 x = 0; x < 24; x++) {
+                        c.SetCornerPos(Corner(slot), x / 3);
+                        c.SetCornerOri(Corner(slot), x % 3);
+                        CornerColor(c, Corner(slot), got);
+                        if (memcmp(got, want, sizeof(got)) == 0) {
+                            sym.corner[s][i][cubie][ori] = slot << 8 | (x / 3) << 4 | x % 3;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (s32 i = 0; i < 12; i++) {
+            s8 p[3];
+            t.Apply(kEdgePositions[i], p);
+            s32 slot = FindSlot(kEdgePositions, 12, p);
+            u8 from[2], to[2];
+            EdgeAxes(i, from);
+            EdgeAxes(slot, to);
+            for (s32 cubie = 0; cubie < 12; cubie++) {
+                for (s32 flip = 0; flip < 2; flip++) {
+                    s32 colors[2], want[2], got[2];
+                    Init(c);
+                    c.SetEdgePos(Edge(i), cubie);
+                    c.SetEdgeOri(Edge(i), flip);
+                    EdgeColor(c, Edge(i), colors);
+                    for (s32 k = 0; k < 2; k++) {
+                        want[to[0] == t.to[from[k]] ? 0 : 1] = paint[colors[k]];
+                    }
+                    sym.edge[s][i][cubie][flip] = 0xffff;
+                    for (s32 x = 0; x < 24; x++) {
+                        c.SetEdgePos(Edge(slot), x / 2);
+                        c.SetEdgeOri(Edge(slot), x % 2);
+                        EdgeColor(c, Edge(slot), got);
+                        if (memcmp(got, want, sizeof(got)) == 0) {
+                            sym.edge[s][i][cubie][flip] = slot << 8 | (x / 2) << 4 | x % 2;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // A move maps to the move that the symmetry makes of it, which we find by
+    // conjugating the move applied to a solved cube.
+    Cube solved;
+    Init(solved);
+    for (s32 s = 0; s < NUM_SYMMETRIES; s++) {
+        for (s32 m = 0; m < 18; m++) {
+            Cube c = solved;
+            ApplyMove(c, m);
+            c = Conjugate(c, s, sym);
+            for (s32 m2 = 0; m2 < 18; m2++) {
+                Cube d = solved;
+                ApplyMove(d, m2);
+                if (c == d) {
+                    sym.move[s][m] = m2;
+                }
+            }
+        }
+    }
+
+    // The inverse undoes the conjugation of a cube that has no symmetries.
+    Cube scrambled = solved;
+    static const u8 kScramble[] = {0, 7, 14, 3, 10, 17, 1, 6, 12};
+    for (u8 m : kScramble) {
+        ApplyMove(scrambled, m);
+    }
+    for (s32 s = 0; s < NUM_SYMMETRIES; s++) {
+        Cube c = Conjugate(scrambled, s, sym);
+        for (s32 s2 = 0; s2 < NUM_SYMMETRIES; s2++) {
+            if (Conjugate(c, s2, sym) == scrambled) {
+                sym.inverse[s] = s2;
+            }
+        }
+    }
+    return sym;
+}
+
+internal const Symmetries &GetSymmetries() {
+    static const Symmetries sym = GenerateSymmetries();
+    return sym;
+}
+
+// Representative of the 48 conjugates of `c`, the one with the smallest
+// edges and corners. Returns the symmetry that maps `c` onto it.
+internal s32 Canonicalize(const Cube &c, Cube &canonical) {
+    const Symmetries &sym = GetSymmetries();
+    s32 best = 0;
+    canonical = Conjugate(c, 0, sym);
+    for (s32 s = 1; s < NUM_SYMMETRIES; s++) {
+        Cube x = Conjugate(c, s, sym);
+        if (x.edges < canonical.edges ||
+            (x.edges == canonical.edges && x.corners < canonical.corners)) {
+            canonical = x;
+            best = s;
+        }
+    }
+    return best;
+}
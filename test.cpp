@@ -0,0 +1,91 @@
+#include <clocale>
+
+#include "rubiks.h"
+
+/// Solves scrambles of known optimal length in every mode of the library, and
+/// with SolveBatch(), and checks the lengths. The scrambles are built with
+/// ApplyMove(), as a user of the library would, so their cubes still hold the
+/// last move. Run from the directory that holds data/.
+
+struct Scramble {
+    u8 moves[10];
+    s32 optimal;
+};
+
+// Ten random moves each, the lengths found by the bidirectional search.
+static const Scramble kScrambles[] = {
+    {{5, 14, 15, 17, 15, 13, 13, 7, 5, 1}, 6},
+    {{2, 6, 2, 14, 17, 1, 1, 2, 1, 6}, 7},
+    {{15, 4, 1, 13, 5, 17, 16, 14, 1, 1}, 7},
+    {{14, 4, 13, 11, 4, 9, 6, 15, 16, 10}, 9},
+    {{16, 1, 16, 16, 15, 13, 0, 15, 15, 17}, 6},
+    {{1, 13, 3, 2, 8, 6, 17, 4, 2, 0}, 6},
+    {{3, 16, 5, 17, 7, 7, 6, 12, 2, 4}, 8},
+    {{4, 0, 5, 0, 17, 1, 11, 15, 16, 8}, 7},
+};
+
+#define NUM_SCRAMBLES s32(sizeof(kScrambles) / sizeof(kScrambles[0]))
+
+// False if `solution` does not solve `root` in `optimal` moves.
+internal bool Check(const char *mode, s32 i, Cube root,
+                    const Solution &solution, s32 optimal) {
+    for (s32 k = 0; k < solution.length; k++) {
+        ApplyMove(root, solution.moves[k]);
+    }
+    Cube goal;
+    Init(goal);
+    if (solution.length != optimal || !(root == goal)) {
+        printf("%s: scramble %d solved in %d moves, optimal is %d\n", mode, i,
+               solution.length, optimal);
+        return false;
+    }
+    return true;
+}
+
+s32 main() {
+    setlocale(LC_NUMERIC, "");
+
+    DatabaseSet dbs;
+    if (!dbs.Load("data")) {
+        printf("the databases in data/ are missing\n");
+        return 1;
+    }
+    Solver solver(dbs);
+
+    Cube roots[NUM_SCRAMBLES];
+    for (s32 i = 0; i < NUM_SCRAMBLES; i++) {
+        Init(roots[i]);
+        for (u8 move : kScrambles[i].moves) {
+            ApplyMove(roots[i], move);
+        }
+    }
+
+    const char *names[] = {"default",  "adaptive", "symmetric", "bpmx",
+                           "table",    "fringe",   "astar",     "bidir"};
+    SolveOptions modes[8];
+    modes[1].adaptive = true;
+    modes[2].symmetric = true;
+    modes[3].bpmx = true;
+    modes[4].table_memory = MiB(16);
+    modes[5].fringe_memory = MiB(64);
+    modes[6].astar_memory = MiB(64);
+    modes[7].bidir_memory = MiB(64);
+
+    s32 failed = 0;
+    for (s32 m = 0; m < 8; m++) {
+        for (s32 i = 0; i < NUM_SCRAMBLES; i++) {
+            Solution solution = solver.Solve(roots[i], modes[m]);
+            failed += !Check(names[m], i, roots[i], solution,
+                             kScrambles[i].optimal);
+        }
+    }
+
+    Solution batch[NUM_SCRAMBLES];
+    solver.SolveBatch(roots, batch, NUM_SCRAMBLES, 4);
+    for (s32 i = 0; i < NUM_SCRAMBLES; i++) {
+        failed += !Check("batch", i, roots[i], batch[i], kScrambles[i].optimal);
+    }
+
+    printf("%d of %d solves failed\n", failed, 9 * NUM_SCRAMBLES);
+    return failed ? 1 : 0;
+}
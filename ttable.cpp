@@ -0,0 +1,122 @@
+#pragma once
+
+/// Transposition table for IDA*. kValidMoves only removes the trivial
+/// redundant sequences, many others still reach the same state within one
+/// iteration. The table keeps the smallest g every state was expanded at in
+/// the current iteration, and Dfs() skips a state it reaches again at the
+/// same or a larger g: its subtree was searched with at least as much of the
+/// bound left, and any next bound it has was already taken into account.
+///
+/// Its size is fixed. Buckets of four entries fill a cache line, and a full
+/// bucket replaces an entry of an earlier iteration, otherwise the one with
+/// the largest g, whose subtree is the smallest.
+///
+/// The table is lock-free, so that searches of the same cube can share it,
+/// such as the worker processes of a distributed solve through a shared
+/// file. An entry is two words, written one after the other:
+///
+///   word 1   corners (48 bits) | g << 48 | bound << 53
+///   word 0   edges ^ word 1
+///
+/// A reader that sees the words of two different writes finds that they do
+/// not match its state, and misses.
+
+#define TABLE_WAYS 4
+#define TABLE_G_SHIFT 48
+#define TABLE_BOUND_SHIFT 53
+
+struct TranspositionTable {
+    u64 *words{nullptr};
+    u64 bytes{0};
+    // buckets - 1
+    u64 mask{0};
+
+    ~TranspositionTable() { Free(); }
+
+    // Anonymous, or mapped from the file at `path`, which is created if it
+    // does not exist, so that every process that maps it shares the entries.
+    bool Init(u64 size, const char *path = nullptr) {
+        Free();
+        u64 buckets = 1;
+        while (buckets * 2 * 64 <= size) {
+            buckets *= 2;
+        }
+        bytes = buckets * 64;
+        void *p;
+        if (path) {
+            s32 fd = open(path, O_RDWR | O_CREAT, 0664);
+            if (fd == -1 || ftruncate(fd, bytes) == -1) {
+                perror(path);
+                if (fd != -1) {
+                    close(fd);
+                }
+                return false;
+            }
+            p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+        } else {
+            p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        }
+        if (p == MAP_FAILED) {
+            perror("mmap");
+            return false;
+        }
+        words = (u64 *)p;
+        mask = buckets - 1;
+        return true;
+    }
+
+    void Free() {
+        if (words) {
+            munmap(words, bytes);
+        }
+        words = nullptr;
+    }
+
+    u64 *Bucket(const Cube &cube) const {
+        return words + (StateHash(cube) & mask) * TABLE_WAYS * 2;
+    }
+
+    void Prefetch(const Cube &cube) const {
+        __builtin_prefetch(Bucket(cube), 1);
+    }
+
+    // True if `cube` was already reached at `g` or less in the iteration of
+    // `bound`, otherwise records it at `g`.
+    bool Visit(const Cube &cube, u8 g, u8 bound) {
+        u64 corners = cube.corners & 0xffffffffffffull;
+        u64 edges = cube.edges & 0xfffffffffffffffull;
+        u64 *bucket = Bucket(cube);
+        s32 victim = 0, worst = -1;
+        for (s32 i = 0; i < TABLE_WAYS; i++) {
+            u64 w0 = __atomic_load_n(&bucket[2 * i], __ATOMIC_RELAXED);
+            u64 w1 = __atomic_load_n(&bucket[2 * i + 1], __ATOMIC_RELAXED);
+            u8 eg = (w1 >> TABLE_G_SHIFT) & 31;
+            bool current = (w1 >> TABLE_BOUND_SHIFT) == bound;
+            if ((w1 & 0xffffffffffffull) == corners && (w0 ^ w1) == edges) {
+                if (current && eg <= g) {
+                    return true;
+                }
+                victim = i;
+                break;
+            }
+            s32 rank = current ? eg : 32;
+            if (rank > worst) {
+                worst = rank;
+                victim = i;
+            }
+        }
+        u64 w1 = corners | u64(g) << TABLE_G_SHIFT |
+                 u64(bound) << TABLE_BOUND_SHIFT;
+        __atomic_store_n(&bucket[2 * victim], edges ^ w1, __ATOMIC_RELAXED);
+        __atomic_store_n(&bucket[2 * victim + 1], w1, __ATOMIC_RELAXED);
+        return false;
+    }
+};
+
+bool CreateTranspositionTable(const char *path, u64 bytes) {
+    unlink(path);
+    TranspositionTable table;
+    return table.Init(bytes, path);
+}
@@ -46,4 +46,10 @@ internal T Max(T a, T b) {
 
 internal inline f64 Timespec2Sec(const struct timespec* ts) {
     return (f64)ts->tv_sec + (f64)ts->tv_nsec / 1.0e9;
+}
+
+internal inline f64 Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return Timespec2Sec(&ts);
 }
\ No newline at end of file
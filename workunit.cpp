@@ -0,0 +1,296 @@
+#pragma once
+
+/// Work units split a solve across processes, possibly on other machines. The
+/// coordinator expands the root to a fixed depth, removes duplicate states and
+/// deals the nodes out to unit files, together with the bound of the current
+/// iteration. A worker searches the subtrees of one unit against its own
+/// databases and writes its result next to it. Once all results are in, the
+/// coordinator either has a solution or raises the bound of every unit to the
+/// smallest next bound, and starts the next round.
+///
+///   WorkUnitHeader
+///   WorkNode[num_nodes]
+///
+/// A result is a line of text in <unit>.result, one of
+///
+///   found <nodes> <length> <move>...
+///   next <nodes> <bound>
+
+#define WORK_MAGIC 0xfeffc2fe
+#define WORK_MAX_DEPTH 6
+
+struct WorkUnitHeader {
+    Cube root;
+    u32 magic;
+    u32 num_nodes;
+    u8 bound;
+    u8 depth;
+};
+
+struct WorkNode {
+    // from the root
+    u8 moves[WORK_MAX_DEPTH];
+    // Moves a worker may continue with. A state reached with different last
+    // moves is kept once, with the moves that are valid after any of them.
+    u32 allowed;
+};
+
+struct SplitNode {
+    Cube cube;
+    WorkNode node;
+};
+
+internal s32 CompareStates(const void *a, const void *b) {
+    const Cube &x = ((const SplitNode *)a)->cube;
+    const Cube &y = ((const SplitNode *)b)->cube;
+    // the last move is stored in the corners, above the mask
+    u64 xc = x.corners & 0xffffffffffffull, yc = y.corners & 0xffffffffffffull;
+    if (x.edges != y.edges) {
+        return x.edges < y.edges ? -1 : 1;
+    }
+    return xc < yc ? -1 : xc > yc;
+}
+
+internal bool WriteWorkUnit(const char *path, const WorkUnitHeader &hdr,
+                            const WorkNode *nodes) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("fopen");
+        return false;
+    }
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+              fwrite(nodes, sizeof(WorkNode), hdr.num_nodes, file) ==
+                  hdr.num_nodes;
+    return fclose(file) == 0 && ok;
+}
+
+// Reads the header, and the nodes if `nodes` is given, which the caller frees.
+internal bool ReadWorkUnit(const char *path, WorkUnitHeader &hdr,
+                           WorkNode **nodes) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("fopen");
+        return false;
+    }
+    bool ok = fread(&hdr, sizeof(hdr), 1, file) == 1 &&
+              hdr.magic == WORK_MAGIC && hdr.depth <= WORK_MAX_DEPTH;
+    if (ok && nodes) {
+        *nodes = (WorkNode *)malloc(Max(hdr.num_nodes, 1u) * sizeof(WorkNode));
+        ok = *nodes && fread(*nodes, sizeof(WorkNode), hdr.num_nodes, file) ==
+                           hdr.num_nodes;
+    }
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "'%s' is not a work unit\n", path);
+    }
+    return ok;
+}
+
+bool SetWorkUnitBound(const char *unit, u8 bound) {
+    WorkUnitHeader hdr;
+    if (!ReadWorkUnit(unit, hdr, NULL)) {
+        return false;
+    }
+    hdr.bound = bound;
+    FILE *file = fopen(unit, "r+b");
+    bool ok = file && fwrite(&hdr, sizeof(hdr), 1, file) == 1;
+    return file && fclose(file) == 0 && ok;
+}
+
+bool ReadWorkResult(const char *unit, WorkResult &result) {
+    char path[4096 + 8];
+    snprintf(path, sizeof(path), "%s.result", unit);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    char kind[8];
+    s32 n = 0, length = 0, next = 0;
+    bool ok = fscanf(file, "%7s %lu", kind, &result.nodes) == 2;
+    result.found = ok && strcmp(kind, "found") == 0;
+    if (result.found) {
+        ok = fscanf(file, "%d", &length) == 1 && length >= 0 &&
+             length <= MAX_DEPTH;
+        for (n = 0; ok && n < length; n++) {
+            s32 move;
+            ok = fscanf(file, "%d", &move) == 1 && move >= 0 && move < 18;
+            result.solution.moves[n] = move;
+        }
+        result.solution.length = length;
+        result.solution.optimal = true;
+    } else {
+        ok = ok && strcmp(kind, "next") == 0 && fscanf(file, "%d", &next) == 1;
+        result.next = next;
+    }
+    fclose(file);
+    return ok;
+}
+
+s32 Solver::Split(Cube root, s32 depth, s32 units, const char *dir,
+                  Solution &solution, u8 &bound) const {
+    SolveOptions options;
+    Search search(dbs_, options);
+    depth = Min(Max(depth, 1), WORK_MAX_DEPTH);
+    units = Max(units, 1);
+
+    // Every level is searched for the goal, a solution within the depth is
+    // found right away and needs no units.
+    u64 n = 1, capacity = 1;
+    for (s32 d = 0; d < depth; d++) {
+        capacity *= 15;
+    }
+    capacity = capacity * 18 / 15;
+    SplitNode *level = (SplitNode *)malloc(capacity * sizeof(SplitNode));
+    SplitNode *next = (SplitNode *)malloc(capacity * sizeof(SplitNode));
+    if (level == NULL || next == NULL) {
+        printf("could not allocate memory\n");
+        free(level);
+        free(next);
+        return -1;
+    }
+    root.SetLastMoveIndex(0);
+    level[0] = {root, {}};
+    for (s32 d = 0; d <= depth; d++) {
+        for (u64 i = 0; i < n; i++) {
+            if (level[i].cube == search.goal) {
+                solution.length = d;
+                solution.optimal = true;
+                memcpy(solution.moves, level[i].node.moves, d);
+                free(level);
+                free(next);
+                return 0;
+            }
+        }
+        if (d == depth) {
+            break;
+        }
+        u64 m = 0;
+        for (u64 i = 0; i < n; i++) {
+            u32 valid = kValidMoves[level[i].cube.GetLastMoveIndex()];
+            while (valid) {
+                s32 move = __builtin_ffs(valid) - 1;
+                valid &= valid - 1;
+                next[m] = level[i];
+                ApplyMove(next[m].cube, move);
+                next[m].node.moves[d] = move;
+                m++;
+            }
+        }
+        Swap(level, next);
+        n = m;
+    }
+
+    qsort(level, n, sizeof(SplitNode), CompareStates);
+    u64 unique = 0;
+    for (u64 i = 0; i < n; i++) {
+        u32 allowed = kValidMoves[level[i].cube.GetLastMoveIndex()];
+        if (unique > 0 && level[i].cube == level[unique - 1].cube) {
+            level[unique - 1].node.allowed |= allowed;
+            continue;
+        }
+        level[unique] = level[i];
+        level[unique++].node.allowed = allowed;
+    }
+
+    // nodes are dealt out in turn, neighbors in the sorted order have nothing
+    // in common, so every unit gets a similar mix
+    units = Min(u64(units), unique);
+    bound = Max(search.Heuristic(root, 0, NOT_FOUND), u8(depth + 1));
+    mkdir(dir, 0775);
+    WorkNode *nodes = (WorkNode *)next;
+    bool ok = true;
+    for (s32 k = 0; ok && k < units; k++) {
+        WorkUnitHeader hdr = {root, WORK_MAGIC, 0, bound, u8(depth)};
+        for (u64 i = k; i < unique; i += units) {
+            nodes[hdr.num_nodes++] = level[i].node;
+        }
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/unit.%d", dir, k);
+        ok = WriteWorkUnit(path, hdr, nodes);
+    }
+    printf("%'lu nodes at depth %d, %'lu states in %d units\n", n, depth,
+           unique, units);
+    free(level);
+    free(next);
+    return ok ? units : -1;
+}
+
+bool Solver::Work(const char *unit, u64 table_memory) const {
+    WorkUnitHeader hdr;
+    WorkNode *nodes;
+    if (!ReadWorkUnit(unit, hdr, &nodes)) {
+        return false;
+    }
+    SolveOptions options;
+    Search search(dbs_, options);
+    // the workers of a round share the table next to the units
+    TranspositionTable table;
+    if (table_memory > 0) {
+        char path[4096 + 8];
+        const char *slash = strrchr(unit, '/');
+        s32 n = slash ? s32(slash - unit) : 1;
+        snprintf(path, sizeof(path), "%.*s/table", n, slash ? unit : ".");
+        if (!table.Init(table_memory, path)) {
+            free(nodes);
+            return false;
+        }
+        search.table = &table;
+    }
+    Cube path[MAX_DEPTH];
+    u8 d = hdr.depth, next = NOT_FOUND, t = NOT_FOUND;
+    path[0] = hdr.root;
+    for (u32 i = 0; i < hdr.num_nodes && t != FOUND; i++) {
+        for (u8 k = 0; k < d; k++) {
+            path[k + 1] = path[k];
+            ApplyMove(path[k + 1], nodes[i].moves[k]);
+        }
+        // the children are checked here, Dfs() only checks grandchildren
+        u32 valid = nodes[i].allowed;
+        while (valid && t != FOUND) {
+            s32 move = __builtin_ffs(valid) - 1;
+            valid &= valid - 1;
+            path[d + 1] = path[d];
+            ApplyMove(path[d + 1], move);
+            search.nodes++;
+            u8 h = search.Heuristic(path[d + 1], d, hdr.bound);
+            if (d + 1 + h > hdr.bound) {
+                next = Min(u8(d + 1 + h), next);
+                continue;
+            }
+            t = search.Dfs(path, d + 1, hdr.bound);
+            next = Min(t, next);
+        }
+    }
+    free(nodes);
+
+    char result[64 + MAX_DEPTH * 3];
+    s32 n = 0;
+    if (t == FOUND) {
+        Solution solution;
+        search.ExtractSolution(path, solution);
+        n = snprintf(result, sizeof(result), "found %lu %d", search.nodes,
+                     solution.length);
+        for (s32 i = 0; i < solution.length; i++) {
+            n += snprintf(result + n, sizeof(result) - n, " %d",
+                          solution.moves[i]);
+        }
+        n += snprintf(result + n, sizeof(result) - n, "\n");
+    } else {
+        n = snprintf(result, sizeof(result), "next %lu %d\n", search.nodes,
+                     next);
+    }
+
+    // written under a temporary name, so the coordinator never sees half a
+    // result
+    char path_tmp[4096 + 16], path_result[4096 + 8];
+    snprintf(path_tmp, sizeof(path_tmp), "%s.result.tmp", unit);
+    snprintf(path_result, sizeof(path_result), "%s.result", unit);
+    FILE *file = fopen(path_tmp, "w");
+    bool ok = file && fwrite(result, 1, n, file) == u64(n);
+    ok = file && fclose(file) == 0 && ok;
+    if (!ok || rename(path_tmp, path_result) == -1) {
+        perror("result");
+        return false;
+    }
+    return true;
+}